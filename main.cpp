@@ -9,21 +9,11 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 	
-	FILE *swffile = fopen(argv[1], "r");
-	if(swffile == NULL) {
+	SWF::Parser parser;
+	if(parser.parse_swf_file(argv[1]) == SWF::Error::SWF_FILE_OPEN_ERROR) {
 		printf("File could not be opened.");
 		return 2;
 	}
-	fseek(swffile, 0, SEEK_END);
-	uint32_t datalen = ftell(swffile);
-	rewind(swffile);
-	uint8_t *data = (uint8_t*)malloc((datalen+1)*sizeof(uint8_t));
-	fread(data, datalen, 1, swffile);
-
-	SWF::Parser parser;
-	parser.parse_swf_data(data, datalen);
-	
-	fclose(swffile);
 	
 	printf("Done.");
 	return 0;
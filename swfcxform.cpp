@@ -0,0 +1,203 @@
+#include "swfcxform.h"
+#include "swfsimd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef LIBSHOCKWAVE_SSE2
+	#include <emmintrin.h>
+#endif
+#ifdef LIBSHOCKWAVE_AVX2
+	#include <immintrin.h>
+#endif
+using namespace SWF;
+
+static_assert(sizeof(RGBA)==4, "RGBA arrays are processed as packed bytes");
+
+#define CXFORM_MIN_ALPHA	(1.0f/256.0f)	// Keeps unpremultiplying a transparent colour finite
+
+// Terms per channel, twice over so that the AVX2 kernels can load two pixels' worth
+struct Terms
+{
+	alignas(32) float mult[8];
+	alignas(32) float add[8];
+};
+
+static void load_terms(const CXForm &cx, Terms &terms)
+{
+	for(int i=0; i<8; i+=4) {
+		terms.mult[i] = cx.RedMultTerm;		terms.add[i] = cx.RedAddTerm;
+		terms.mult[i+1] = cx.GreenMultTerm;	terms.add[i+1] = cx.GreenAddTerm;
+		terms.mult[i+2] = cx.BlueMultTerm;	terms.add[i+2] = cx.BlueAddTerm;
+		terms.mult[i+3] = cx.AlphaMultTerm;	terms.add[i+3] = cx.AlphaAddTerm;
+	}
+}
+
+// The scalar kernels finish the tails of the vector ones, so they round the same way (to nearest even)
+static inline float clamp_channel(float v)
+{
+	return std::min(std::max(v, 0.0f), 255.0f);
+}
+
+static void cxform_scalar(const Terms &terms, const uint8_t *in, uint8_t *out, size_t count)
+{
+	for(size_t i=0; i<count*4; i++)
+		out[i] = (uint8_t)lrintf(clamp_channel(in[i]*terms.mult[i&3] + terms.add[i&3]));
+}
+
+static void cxform_premultiplied_scalar(const Terms &terms, const uint8_t *in, uint8_t *out, size_t count)
+{
+	for(size_t i=0; i<count; i++, in+=4, out+=4) {
+		float unpremultiply = 255.0f/std::max((float)in[3], CXFORM_MIN_ALPHA);
+		float alpha = clamp_channel(in[3]*terms.mult[3] + terms.add[3]);
+		float premultiply = alpha*(1.0f/255.0f);
+		for(int channel=0; channel<3; channel++)
+			out[channel] = (uint8_t)lrintf(clamp_channel((in[channel]*unpremultiply)*terms.mult[channel] + terms.add[channel])*premultiply);
+		out[3] = (uint8_t)lrintf(alpha);
+	}
+}
+
+#ifdef LIBSHOCKWAVE_SSE2
+static inline __m128 transform_sse2(__m128 v, __m128 mult, __m128 add)
+{
+	return _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(v, mult), add), _mm_setzero_ps()), _mm_set1_ps(255.0f));
+}
+
+static inline __m128 transform_premultiplied_sse2(__m128 v, __m128 mult, __m128 add)
+{
+	const __m128 alphamask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 alpha = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,3,3));
+	__m128 unpremultiply = _mm_div_ps(_mm_set1_ps(255.0f), _mm_max_ps(alpha, _mm_set1_ps(CXFORM_MIN_ALPHA)));
+	unpremultiply = _mm_or_ps(_mm_and_ps(alphamask, one), _mm_andnot_ps(alphamask, unpremultiply));
+	v = transform_sse2(_mm_mul_ps(v, unpremultiply), mult, add);
+	__m128 premultiply = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,3,3)), _mm_set1_ps(1.0f/255.0f));
+	premultiply = _mm_or_ps(_mm_and_ps(alphamask, one), _mm_andnot_ps(alphamask, premultiply));
+	return _mm_mul_ps(v, premultiply);
+}
+
+// Four pixels per step: widen the bytes to one float vector per pixel, transform, and pack back
+template<bool premultiplied>
+static void cxform_sse2(const Terms &terms, const uint8_t *in, uint8_t *out, size_t count)
+{
+	const __m128 mult = _mm_load_ps(terms.mult);
+	const __m128 add = _mm_load_ps(terms.add);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i+4<=count; i+=4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(in+i*4));
+		__m128i lo = _mm_unpacklo_epi8(pixels, zero);
+		__m128i hi = _mm_unpackhi_epi8(pixels, zero);
+		__m128 p[4] = {
+			_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)),
+			_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero))
+		};
+		for(int k=0; k<4; k++)
+			p[k] = premultiplied ? transform_premultiplied_sse2(p[k], mult, add) : transform_sse2(p[k], mult, add);
+		__m128i packedlo = _mm_packs_epi32(_mm_cvtps_epi32(p[0]), _mm_cvtps_epi32(p[1]));
+		__m128i packedhi = _mm_packs_epi32(_mm_cvtps_epi32(p[2]), _mm_cvtps_epi32(p[3]));
+		_mm_storeu_si128((__m128i*)(out+i*4), _mm_packus_epi16(packedlo, packedhi));
+	}
+	if(premultiplied)	cxform_premultiplied_scalar(terms, in+i*4, out+i*4, count-i);
+	else				cxform_scalar(terms, in+i*4, out+i*4, count-i);
+}
+#endif
+
+#ifdef LIBSHOCKWAVE_AVX2
+LIBSHOCKWAVE_TARGET_AVX2 static inline __m256 transform_avx2(__m256 v, __m256 mult, __m256 add)
+{
+	return _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(v, mult), add), _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+}
+
+// Each 128-bit lane holds one pixel, so the alpha broadcasts stay within lanes
+LIBSHOCKWAVE_TARGET_AVX2 static inline __m256 transform_premultiplied_avx2(__m256 v, __m256 mult, __m256 add)
+{
+	const __m256 alphamask = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+	const __m256 one = _mm256_set1_ps(1.0f);
+	__m256 alpha = _mm256_permute_ps(v, _MM_SHUFFLE(3,3,3,3));
+	__m256 unpremultiply = _mm256_div_ps(_mm256_set1_ps(255.0f), _mm256_max_ps(alpha, _mm256_set1_ps(CXFORM_MIN_ALPHA)));
+	unpremultiply = _mm256_blendv_ps(unpremultiply, one, alphamask);
+	v = transform_avx2(_mm256_mul_ps(v, unpremultiply), mult, add);
+	__m256 premultiply = _mm256_mul_ps(_mm256_permute_ps(v, _MM_SHUFFLE(3,3,3,3)), _mm256_set1_ps(1.0f/255.0f));
+	premultiply = _mm256_blendv_ps(premultiply, one, alphamask);
+	return _mm256_mul_ps(v, premultiply);
+}
+
+// Eight pixels per step, two to a vector. Packing works within lanes, so the result comes out
+// as pixels 0,2,4,6 then 1,3,5,7 and is permuted back into order.
+template<bool premultiplied>
+LIBSHOCKWAVE_TARGET_AVX2 static void cxform_avx2(const Terms &terms, const uint8_t *in, uint8_t *out, size_t count)
+{
+	const __m256 mult = _mm256_load_ps(terms.mult);
+	const __m256 add = _mm256_load_ps(terms.add);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	size_t i = 0;
+	for(; i+8<=count; i+=8) {
+		__m256 p[4];
+		for(int k=0; k<4; k++) {
+			p[k] = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in+i*4+k*8))));
+			p[k] = premultiplied ? transform_premultiplied_avx2(p[k], mult, add) : transform_avx2(p[k], mult, add);
+		}
+		__m256i packedlo = _mm256_packs_epi32(_mm256_cvtps_epi32(p[0]), _mm256_cvtps_epi32(p[1]));
+		__m256i packedhi = _mm256_packs_epi32(_mm256_cvtps_epi32(p[2]), _mm256_cvtps_epi32(p[3]));
+		__m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(packedlo, packedhi), order);
+		_mm256_storeu_si256((__m256i*)(out+i*4), packed);
+	}
+	if(premultiplied)	cxform_premultiplied_scalar(terms, in+i*4, out+i*4, count-i);
+	else				cxform_scalar(terms, in+i*4, out+i*4, count-i);
+}
+#endif
+
+template<bool premultiplied>
+static void cxform_dispatch(const CXForm &cx, const RGBA *in, RGBA *out, size_t count)
+{
+	if(!cx.IsModified()) {
+		if(in!=out)
+			memmove(out, in, count*sizeof(RGBA));
+		return;
+	}
+	Terms terms;
+	load_terms(cx, terms);
+	const uint8_t *src = reinterpret_cast<const uint8_t*>(in);
+	uint8_t *dst = reinterpret_cast<uint8_t*>(out);
+#ifdef LIBSHOCKWAVE_AVX2
+	if(cpu_has_avx2()) {
+		cxform_avx2<premultiplied>(terms, src, dst, count);
+		return;
+	}
+#endif
+#ifdef LIBSHOCKWAVE_SSE2
+	cxform_sse2<premultiplied>(terms, src, dst, count);
+#else
+	if(premultiplied)	cxform_premultiplied_scalar(terms, src, dst, count);
+	else				cxform_scalar(terms, src, dst, count);
+#endif
+}
+
+void SWF::apply_cxform(const CXForm &cx, const RGBA *in, RGBA *out, size_t count)
+{
+	cxform_dispatch<false>(cx, in, out, count);
+}
+
+void SWF::apply_cxform_premultiplied(const CXForm &cx, const RGBA *in, RGBA *out, size_t count)
+{
+	cxform_dispatch<true>(cx, in, out, count);
+}
+
+static inline int16_t compose_add(int16_t inneradd, float outermult, int16_t outeradd)
+{
+	return (int16_t)std::min(std::max(lrintf(inneradd*outermult + outeradd), -32768L), 32767L);
+}
+
+CXForm SWF::compose_cxforms(const CXForm &outer, const CXForm &inner)
+{
+	CXForm cx;
+	cx.RedMultTerm = inner.RedMultTerm*outer.RedMultTerm;
+	cx.GreenMultTerm = inner.GreenMultTerm*outer.GreenMultTerm;
+	cx.BlueMultTerm = inner.BlueMultTerm*outer.BlueMultTerm;
+	cx.AlphaMultTerm = inner.AlphaMultTerm*outer.AlphaMultTerm;
+	cx.RedAddTerm = compose_add(inner.RedAddTerm, outer.RedMultTerm, outer.RedAddTerm);
+	cx.GreenAddTerm = compose_add(inner.GreenAddTerm, outer.GreenMultTerm, outer.GreenAddTerm);
+	cx.BlueAddTerm = compose_add(inner.BlueAddTerm, outer.BlueMultTerm, outer.BlueAddTerm);
+	cx.AlphaAddTerm = compose_add(inner.AlphaAddTerm, outer.AlphaMultTerm, outer.AlphaAddTerm);
+	return cx;
+}
@@ -0,0 +1,29 @@
+#ifndef LIBSHOCKWAVE_SWF_CXFORM_H
+#define LIBSHOCKWAVE_SWF_CXFORM_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "swftypedefs.h"
+
+namespace SWF
+{
+
+	// Apply a colour transform to count colours: each channel becomes clamp(c*Mult + Add, 0, 255),
+	// rounded to nearest. in and out may be the same array. Identity transforms are a copy.
+	// The kernels use AVX2 when the CPU has it and SSE2 otherwise; every path gives the same bytes.
+	void apply_cxform(const CXForm&, const RGBA *in, RGBA *out, size_t count);
+
+	// As apply_cxform(), for premultiplied colours: each is unpremultiplied, transformed and
+	// premultiplied again by its new alpha. Fully transparent colours have no colour to keep,
+	// so they come out as the add terms alone.
+	void apply_cxform_premultiplied(const CXForm&, const RGBA *in, RGBA *out, size_t count);
+
+	// Returns the single transform equal to applying inner and then outer, as a sprite's
+	// transform wraps the transforms of the characters placed inside it. Clamping between the
+	// two steps is lost, and combined add terms are rounded to whole units.
+	CXForm compose_cxforms(const CXForm &outer, const CXForm &inner);
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_CXFORM_H
@@ -0,0 +1,205 @@
+#include "swfexport.h"
+#include "swfthreadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cerrno>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <csignal>
+#include <pthread.h>
+#endif
+using namespace SWF;
+
+#ifndef _WIN32
+// The writer thread keeps SIGPIPE blocked, so a reader that goes away (say ffmpeg quitting early)
+// fails the write with EPIPE instead of killing the process
+static sigset_t sigpipe_set()
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	return set;
+}
+
+static void discard_sigpipe()
+{
+	sigset_t set = sigpipe_set(), pending;
+	int signal;
+	if(sigpending(&pending)==0 && sigismember(&pending, SIGPIPE))
+		sigwait(&set, &signal);
+}
+#endif
+
+static bool write_all(int fd, const uint8_t *data, size_t length)
+{
+	while(length) {
+		#ifdef _WIN32
+		int written = _write(fd, data, (unsigned)std::min<size_t>(length, 1<<30));
+		#else
+		ssize_t written = write(fd, data, length);
+		#endif
+		if(written<0) {
+			if(errno==EINTR)
+				continue;
+			#ifndef _WIN32
+			if(errno==EPIPE)
+				discard_sigpipe();
+			#endif
+			return false;
+		}
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+void SWF::rgba_to_yuv420(const uint8_t *rgba, uint16_t width, uint16_t height, uint8_t *yuv)
+{
+	uint32_t chromawidth = (width+1)/2;
+	uint32_t chromaheight = (height+1)/2;
+	uint8_t *yplane = yuv;
+	uint8_t *uplane = yuv+(size_t)width*height;
+	uint8_t *vplane = uplane+(size_t)chromawidth*chromaheight;
+	for(uint32_t y=0; y<height; y++) {
+		const uint8_t *pixel = rgba+(size_t)y*width*4;
+		uint8_t *luma = yplane+(size_t)y*width;
+		for(uint32_t x=0; x<width; x++, pixel+=4)
+			luma[x] = (uint8_t)(((66*pixel[0] + 129*pixel[1] + 25*pixel[2] + 128)>>8) + 16);
+	}
+	for(uint32_t cy=0; cy<chromaheight; cy++) {
+		uint32_t y0 = cy*2, y1 = std::min<uint32_t>(y0+1, height-1);
+		for(uint32_t cx=0; cx<chromawidth; cx++) {
+			uint32_t x0 = cx*2, x1 = std::min<uint32_t>(x0+1, width-1);
+			const uint8_t *p00 = rgba+((size_t)y0*width+x0)*4;
+			const uint8_t *p01 = rgba+((size_t)y0*width+x1)*4;
+			const uint8_t *p10 = rgba+((size_t)y1*width+x0)*4;
+			const uint8_t *p11 = rgba+((size_t)y1*width+x1)*4;
+			int r = (p00[0]+p01[0]+p10[0]+p11[0]+2)>>2;
+			int g = (p00[1]+p01[1]+p10[1]+p11[1]+2)>>2;
+			int b = (p00[2]+p01[2]+p10[2]+p11[2]+2)>>2;
+			uplane[cy*chromawidth+cx] = (uint8_t)(((-38*r - 74*g + 112*b + 128)>>8) + 128);
+			vplane[cy*chromawidth+cx] = (uint8_t)(((112*r - 94*g - 18*b + 128)>>8) + 128);
+		}
+	}
+}
+
+Exporter::Exporter(Dictionary *d, Properties *p)
+{
+	dict = d;
+	props = p;
+}
+
+void Exporter::get_size(uint16_t &width, uint16_t &height)
+{
+	width = options.width;
+	height = options.height;
+	if(!width)
+		width = (uint16_t)std::max(lroundf(coord_to_float(props->dimensions.xmax-props->dimensions.xmin)), 1L);
+	if(!height)
+		height = (uint16_t)std::max(lroundf(coord_to_float(props->dimensions.ymax-props->dimensions.ymin)), 1L);
+}
+
+size_t Exporter::get_frame_bytes()
+{
+	if(!props)
+		return 0;
+	uint16_t width, height;
+	get_size(width, height);
+	if(options.format==ExportFormat::YUV420)
+		return (size_t)width*height + 2*(size_t)((width+1)/2)*((height+1)/2);
+	return (size_t)width*height*4;
+}
+
+Error Exporter::export_frames(int fd)
+{
+	if(!dict || !props)
+		return Error::SWF_NULL_DATA;
+	size_t totalframes = dict->Frames.size();
+	if(options.firstframe>=totalframes)
+		return Error::SWF_DATA_INVALID;
+	size_t first = options.firstframe;
+	size_t last = options.framecount ? std::min(totalframes, first+options.framecount) : totalframes;
+	uint16_t width, height;
+	get_size(width, height);
+	bool yuv = (options.format==ExportFormat::YUV420);
+
+	ThreadPool pool(options.threads);
+	unsigned window = options.window ? options.window : 2*pool.size();
+	std::vector<Slot> slots(window);
+	for(Slot &slot : slots) {
+		slot.frame = 0;
+		slot.ready = false;
+		slot.rgba.resize((size_t)width*height*4);
+		if(yuv)
+			slot.yuv.resize(get_frame_bytes());
+	}
+	std::vector<std::unique_ptr<Renderer> > renderers(pool.size());	// Single threaded; the parallelism is across frames
+
+	std::mutex mutex;
+	std::condition_variable slotfree;
+	std::condition_variable slotready;
+	size_t written = first;
+	bool failed = false;
+
+	std::thread writer([&]() {
+		#ifndef _WIN32
+		sigset_t sigpipe = sigpipe_set();
+		pthread_sigmask(SIG_BLOCK, &sigpipe, NULL);
+		#endif
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(size_t frame=first; frame<last; frame++) {
+			Slot &slot = slots[(frame-first)%window];
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slotready.wait(lock, [&]() { return failed || (slot.ready && slot.frame==frame); });
+				if(failed)
+					return;
+			}
+			if(options.paced && props->framerate>0.0f)
+				std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((frame-first)/props->framerate)));
+			const std::vector<uint8_t> &data = yuv ? slot.yuv : slot.rgba;
+			bool ok = write_all(fd, data.data(), data.size());
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slot.ready = false;
+				if(ok)	written = frame+1;
+				else	failed = true;
+			}
+			slotfree.notify_all();
+			if(!ok)
+				return;
+		}
+	});
+
+	pool.parallel_for(last-first, [&](size_t i, unsigned worker) {
+		size_t frame = first+i;
+		Slot &slot = slots[i%window];
+		{
+			// Frames are handed out in order, so the one the writer needs next is never stuck here
+			std::unique_lock<std::mutex> lock(mutex);
+			slotfree.wait(lock, [&]() { return failed || frame<written+window; });
+			if(failed)
+				return;
+		}
+		if(!renderers[worker])
+			renderers[worker].reset(new Renderer(dict, props, 1));
+		renderers[worker]->render_frame(frame, width, height, slot.rgba.data());
+		if(yuv)
+			rgba_to_yuv420(slot.rgba.data(), width, height, slot.yuv.data());
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			slot.frame = frame;
+			slot.ready = true;
+		}
+		slotready.notify_all();
+	});
+	writer.join();
+	return failed ? Error::SWF_FILE_WRITE_ERROR : Error::OK;
+}
@@ -0,0 +1,65 @@
+#ifndef LIBSHOCKWAVE_SWF_EXPORT_H
+#define LIBSHOCKWAVE_SWF_EXPORT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "swfparser.h"
+#include "swfrenderer.h"
+
+namespace SWF
+{
+
+	enum class ExportFormat
+	{
+		RGBA,	// width*height*4 bytes per frame
+		YUV420	// Planar Y, then U and V at half resolution (BT.601, limited range)
+	};
+
+	struct ExportOptions
+	{
+		ExportFormat format = ExportFormat::RGBA;
+		uint16_t width = 0;	// 0 uses the stage size
+		uint16_t height = 0;
+		unsigned threads = 0;	// 0 uses every core
+		unsigned window = 0;	// Frames rendered ahead of the writer; 0 uses twice the thread count
+		size_t firstframe = 0;
+		size_t framecount = 0;	// 0 runs to the end of the timeline
+		bool paced = false;	// Hold each write until its time at the movie's frame rate, for live consumers
+	};
+
+	// Renders frames on a thread pool and writes them to a file descriptor strictly in order, one
+	// raw frame per SWF frame. Workers render into a ring of window slots and stop once they are a
+	// full window ahead of the writer, so memory stays bounded while the writer always has the next
+	// frame waiting. The output holds one raw frame per timeline frame; tell the encoder to read it
+	// at Properties::framerate.
+	class Exporter
+	{
+		struct Slot
+		{
+			size_t frame;
+			bool ready;
+			std::vector<uint8_t> rgba;
+			std::vector<uint8_t> yuv;
+		};
+		Dictionary *dict;
+		Properties *props;
+		ExportOptions options;
+
+		void get_size(uint16_t&, uint16_t&);
+
+	public:
+		Exporter(Dictionary*, Properties*);
+		void set_options(const ExportOptions &o) { options = o; }
+		const ExportOptions &get_options() { return options; }
+		size_t get_frame_bytes();
+		Error export_frames(int fd);
+	};
+
+	// Converts opaque RGBA8 to planar YUV 4:2:0, averaging chroma over each 2x2 block
+	void rgba_to_yuv420(const uint8_t*, uint16_t, uint16_t, uint8_t*);
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_EXPORT_H
@@ -0,0 +1,141 @@
+#include "swfflatten.h"
+#include <cmath>
+#ifdef LIBSHOCKWAVE_SSE2
+	#include <emmintrin.h>
+#endif
+using namespace SWF;
+
+static inline bool is_curve(const Vertex &v)
+{
+	return coord_to_twips(v.control.x)!=coord_to_twips(v.anchor.x) || coord_to_twips(v.control.y)!=coord_to_twips(v.anchor.y);
+}
+
+static inline uint32_t segments_for(float ddx, float ddy, const Matrix &m, float scale)
+{
+	float tx = ddx*m.ScaleX + ddy*m.RotateSkew1;
+	float ty = ddx*m.RotateSkew0 + ddy*m.ScaleY;
+	float n = ceilf(sqrtf(sqrtf(tx*tx+ty*ty)*scale));
+	if(!(n>=1.0f))	return 1;	// Also catches NaN
+	if(n>FLATTEN_MAX_SEGMENTS)	return FLATTEN_MAX_SEGMENTS;
+	return (uint32_t)n;
+}
+
+size_t SWF::count_quadratic_segments(const QuadraticBatch &curves, const Matrix &m, float tolerance, uint32_t *segments)
+{
+	float scale = 1.0f/(4.0f*tolerance);
+	size_t total = 0;
+	size_t i = 0;
+#ifdef LIBSHOCKWAVE_SSE2
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sx = _mm_set1_ps(m.ScaleX), sy = _mm_set1_ps(m.ScaleY);
+	const __m128 r0 = _mm_set1_ps(m.RotateSkew0), r1 = _mm_set1_ps(m.RotateSkew1);
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 limit = _mm_set1_ps((float)FLATTEN_MAX_SEGMENTS);
+	for(; i+4<=curves.count; i+=4) {
+		__m128 ddx = _mm_add_ps(_mm_sub_ps(_mm_loadu_ps(curves.x0+i), _mm_mul_ps(two, _mm_loadu_ps(curves.cx+i))), _mm_loadu_ps(curves.x1+i));
+		__m128 ddy = _mm_add_ps(_mm_sub_ps(_mm_loadu_ps(curves.y0+i), _mm_mul_ps(two, _mm_loadu_ps(curves.cy+i))), _mm_loadu_ps(curves.y1+i));
+		__m128 tx = _mm_add_ps(_mm_mul_ps(ddx, sx), _mm_mul_ps(ddy, r1));
+		__m128 ty = _mm_add_ps(_mm_mul_ps(ddx, r0), _mm_mul_ps(ddy, sy));
+		__m128 n = _mm_sqrt_ps(_mm_mul_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty))), s));
+		n = _mm_min_ps(_mm_max_ps(n, one), limit);	// NaN becomes 1 as well, since max returns its second operand
+		__m128i whole = _mm_cvttps_epi32(n);
+		__m128i roundup = _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(whole), n));	// SSE2 has no ceil; add 1 where truncation dropped a fraction
+		_mm_storeu_si128((__m128i*)(segments+i), _mm_sub_epi32(whole, roundup));
+		total += segments[i]+segments[i+1]+segments[i+2]+segments[i+3];
+	}
+#endif
+	for(; i<curves.count; i++) {
+		segments[i] = segments_for(curves.x0[i]-2.0f*curves.cx[i]+curves.x1[i], curves.y0[i]-2.0f*curves.cy[i]+curves.y1[i], m, scale);
+		total += segments[i];
+	}
+	return total;
+}
+
+void SWF::flatten_quadratics(const QuadraticBatch &curves, const uint32_t *segments, float *out)
+{
+	for(size_t i=0; i<curves.count; i++) {
+		// P(t) = P0 + t*b + t^2*a, with b = 2(P1-P0) and a = P0-2P1+P2
+		float x0 = curves.x0[i], y0 = curves.y0[i];
+		float bx = 2.0f*(curves.cx[i]-x0), by = 2.0f*(curves.cy[i]-y0);
+		float ax = x0-2.0f*curves.cx[i]+curves.x1[i], ay = y0-2.0f*curves.cy[i]+curves.y1[i];
+		uint32_t n = segments[i];
+		float step = 1.0f/n;
+		uint32_t s = 1;
+#ifdef LIBSHOCKWAVE_SSE2
+		__m128 vx0 = _mm_set1_ps(x0), vy0 = _mm_set1_ps(y0);
+		__m128 vbx = _mm_set1_ps(bx), vby = _mm_set1_ps(by);
+		__m128 vax = _mm_set1_ps(ax), vay = _mm_set1_ps(ay);
+		__m128 vstep = _mm_set1_ps(step);
+		for(; s+4<=n; s+=4) {
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)s), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)), vstep);
+			__m128 px = _mm_add_ps(vx0, _mm_mul_ps(t, _mm_add_ps(vbx, _mm_mul_ps(t, vax))));
+			__m128 py = _mm_add_ps(vy0, _mm_mul_ps(t, _mm_add_ps(vby, _mm_mul_ps(t, vay))));
+			_mm_storeu_ps(out, _mm_unpacklo_ps(px, py));
+			_mm_storeu_ps(out+4, _mm_unpackhi_ps(px, py));
+			out += 8;
+		}
+#endif
+		for(; s<n; s++) {
+			float t = s*step;
+			*out++ = x0 + t*(bx + t*ax);
+			*out++ = y0 + t*(by + t*ay);
+		}
+		*out++ = curves.x1[i];
+		*out++ = curves.y1[i];
+	}
+}
+
+void Flattener::flatten(const Vertex *vertices, uint32_t count, const Matrix &m, float tolerance, std::vector<float> &points)
+{
+	if(!count)
+		return;
+
+	// Gather the curved edges as planes (start x/y, control x/y, end x/y) for the flattening kernel
+	uint32_t curvecount = 0;
+	for(uint32_t i=1; i<count; i++)
+		if(is_curve(vertices[i]))
+			curvecount++;
+	QuadraticBatch batch;
+	if(curvecount) {
+		curves.resize(curvecount*6);
+		float *plane = curves.data();
+		uint32_t c = 0;
+		for(uint32_t i=1; i<count; i++) {
+			if(!is_curve(vertices[i]))
+				continue;
+			plane[c] = coord_to_float(vertices[i-1].anchor.x);
+			plane[curvecount+c] = coord_to_float(vertices[i-1].anchor.y);
+			plane[2*curvecount+c] = coord_to_float(vertices[i].control.x);
+			plane[3*curvecount+c] = coord_to_float(vertices[i].control.y);
+			plane[4*curvecount+c] = coord_to_float(vertices[i].anchor.x);
+			plane[5*curvecount+c] = coord_to_float(vertices[i].anchor.y);
+			c++;
+		}
+		batch.x0 = plane;
+		batch.y0 = plane+curvecount;
+		batch.cx = plane+2*curvecount;
+		batch.cy = plane+3*curvecount;
+		batch.x1 = plane+4*curvecount;
+		batch.y1 = plane+5*curvecount;
+		batch.count = curvecount;
+		segments.resize(curvecount);
+		curvepoints.resize(2*count_quadratic_segments(batch, m, tolerance, segments.data()));
+		flatten_quadratics(batch, segments.data(), curvepoints.data());
+	}
+
+	points.push_back(coord_to_float(vertices[0].anchor.x));
+	points.push_back(coord_to_float(vertices[0].anchor.y));
+	const float *flattened = curvepoints.data();
+	uint32_t c = 0;
+	for(uint32_t i=1; i<count; i++) {
+		if(is_curve(vertices[i])) {
+			points.insert(points.end(), flattened, flattened+2*segments[c]);
+			flattened += 2*segments[c];
+			c++;
+		} else {
+			points.push_back(coord_to_float(vertices[i].anchor.x));
+			points.push_back(coord_to_float(vertices[i].anchor.y));
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef LIBSHOCKWAVE_SWF_FLATTEN_H
+#define LIBSHOCKWAVE_SWF_FLATTEN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "swftypedefs.h"
+#include "swfsimd.h"
+
+namespace SWF
+{
+
+	// Quadratic curves as parallel arrays: start point, control point and end point
+	struct QuadraticBatch
+	{
+		const float *x0 = NULL;
+		const float *y0 = NULL;
+		const float *cx = NULL;
+		const float *cy = NULL;
+		const float *x1 = NULL;
+		const float *y1 = NULL;
+		size_t count = 0;
+	};
+
+	#define FLATTEN_MAX_SEGMENTS	256
+
+	// Works out how many line segments each curve needs so that, once drawn through the matrix,
+	// no point strays more than tolerance pixels from the curve: n = ceil(sqrt(|M(P0-2P1+P2)|/(4*tolerance))).
+	// Fills segments[] and returns the total, which is the number of points flatten_quadratics() writes.
+	size_t count_quadratic_segments(const QuadraticBatch&, const Matrix&, float tolerance, uint32_t *segments);
+
+	// Writes each curve's points after its start as interleaved x,y into out, in the curves' own
+	// space, ending exactly on the curve's end point. out must hold twice the count's total floats.
+	void flatten_quadratics(const QuadraticBatch&, const uint32_t *segments, float *out);
+
+	// Flattens a run of vertices laid out like a Shape (a start point, then edges ending at their
+	// anchors) into a polyline, batching its curves through the kernels above. Keeps its buffers
+	// between calls; use one per thread.
+	class Flattener
+	{
+		std::vector<float> curves;
+		std::vector<uint32_t> segments;
+		std::vector<float> curvepoints;
+
+	public:
+		void flatten(const Vertex*, uint32_t, const Matrix&, float tolerance, std::vector<float> &points);	// Appends x,y pairs
+	};
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_FLATTEN_H
@@ -0,0 +1,318 @@
+#include "swfgradient.h"
+#include "swfsimd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef LIBSHOCKWAVE_SSE2
+	#include <emmintrin.h>
+#endif
+using namespace SWF;
+
+#define LINEAR_TABLE_SIZE	4096
+
+// sRGB byte to linear light, scaled to 0-255 so it shares a range with alpha
+static const float *srgb_to_linear_table()
+{
+	static const std::vector<float> table = []() {
+		std::vector<float> t(256);
+		for(int i=0; i<256; i++) {
+			float c = i/255.0f;
+			t[i] = 255.0f*((c<=0.04045f) ? c/12.92f : powf((c+0.055f)/1.055f, 2.4f));
+		}
+		return t;
+	}();
+	return table.data();
+}
+
+// Linear light at LINEAR_TABLE_SIZE steps back to an sRGB byte
+static const uint8_t *linear_to_srgb_table()
+{
+	static const std::vector<uint8_t> table = []() {
+		std::vector<uint8_t> t(LINEAR_TABLE_SIZE);
+		for(int i=0; i<LINEAR_TABLE_SIZE; i++) {
+			float c = i/float(LINEAR_TABLE_SIZE-1);
+			c = (c<=0.0031308f) ? c*12.92f : 1.055f*powf(c, 1.0f/2.4f)-0.055f;
+			t[i] = (uint8_t)std::min(c*255.0f+0.5f, 255.0f);
+		}
+		return t;
+	}();
+	return table.data();
+}
+
+// The records as float stops in the space they are interpolated in, and the transform's terms
+struct RampStops
+{
+	alignas(16) float stops[GRADIENT_MAX_RECORDS][4];
+	int ratios[GRADIENT_MAX_RECORDS];
+	int count;
+	bool linear;
+	alignas(16) float mult[4];
+	alignas(16) float add[4];
+};
+
+static void load_stops(const Gradient &gradient, const CXForm *cxform, RampStops &r)
+{
+	r.count = std::min<int>(gradient.NumGradients, GRADIENT_MAX_RECORDS);
+	r.linear = (static_cast<GradInterpMode>(gradient.InterpolationMode)==LINEAR_RGB);
+	const float *tolinear = srgb_to_linear_table();
+	for(int i=0; i<r.count; i++) {
+		const GradRecord &record = gradient.GradientRecords[i];
+		r.ratios[i] = record.Ratio;
+		r.stops[i][0] = r.linear ? tolinear[record.Color.r] : record.Color.r;
+		r.stops[i][1] = r.linear ? tolinear[record.Color.g] : record.Color.g;
+		r.stops[i][2] = r.linear ? tolinear[record.Color.b] : record.Color.b;
+		r.stops[i][3] = record.Color.a;
+	}
+	for(int channel=0; channel<4; channel++) {
+		r.mult[channel] = 1.0f;
+		r.add[channel] = 0.0f;
+	}
+	if(cxform) {
+		r.mult[0] = cxform->RedMultTerm;	r.add[0] = cxform->RedAddTerm;
+		r.mult[1] = cxform->GreenMultTerm;	r.add[1] = cxform->GreenAddTerm;
+		r.mult[2] = cxform->BlueMultTerm;	r.add[2] = cxform->BlueAddTerm;
+		r.mult[3] = cxform->AlphaMultTerm;	r.add[3] = cxform->AlphaAddTerm;
+	}
+}
+
+// The stops either side of texel i and how far it lies between them. next is the first record
+// with a ratio at or after the texel, carried from one texel to the next.
+static inline float stops_for(const RampStops &r, int i, int &next, const float *&c0, const float *&c1)
+{
+	while(next<r.count && r.ratios[next]<i)
+		next++;
+	if(next==0) {
+		c0 = c1 = r.stops[0];
+		return 0.0f;
+	}
+	if(next==r.count) {
+		c0 = c1 = r.stops[r.count-1];
+		return 0.0f;
+	}
+	c0 = r.stops[next-1];
+	c1 = r.stops[next];
+	return float(i-r.ratios[next-1])/float(r.ratios[next]-r.ratios[next-1]);
+}
+
+// Both bakers do the same float operations in the same order and round to nearest even, so
+// they produce the same bytes
+static void bake_scalar(const RampStops &r, GradientRamp &ramp)
+{
+	const uint8_t *tosrgb = linear_to_srgb_table();
+	const float tolinearindex = (LINEAR_TABLE_SIZE-1)/255.0f;
+	int next = 0;
+	for(int i=0; i<GRADIENT_RAMP_SIZE; i++) {
+		const float *c0, *c1;
+		float f = stops_for(r, i, next, c0, c1);
+		uint8_t *texel = ramp.texels+i*4;
+		float v[4];
+		for(int channel=0; channel<4; channel++)
+			v[channel] = c0[channel] + (c1[channel]-c0[channel])*f;
+		if(r.linear) {
+			for(int channel=0; channel<3; channel++)
+				v[channel] = tosrgb[lrintf(v[channel]*tolinearindex)];
+		}
+		for(int channel=0; channel<4; channel++)
+			v[channel] = std::min(std::max(v[channel]*r.mult[channel] + r.add[channel], 0.0f), 255.0f);
+		float premultiply = v[3]*(1.0f/255.0f);
+		for(int channel=0; channel<3; channel++)
+			texel[channel] = (uint8_t)lrintf(v[channel]*premultiply);
+		texel[3] = (uint8_t)lrintf(v[3]);
+	}
+}
+
+#ifdef LIBSHOCKWAVE_SSE2
+static void bake_sse2(const RampStops &r, GradientRamp &ramp)
+{
+	const uint8_t *tosrgb = linear_to_srgb_table();
+	const float tolinearindex = (LINEAR_TABLE_SIZE-1)/255.0f;
+	const __m128 vmult = _mm_load_ps(r.mult);
+	const __m128 vadd = _mm_load_ps(r.add);
+	const __m128 vzero = _mm_setzero_ps();
+	const __m128 vmax = _mm_set1_ps(255.0f);
+	const __m128 vindex = _mm_set_ps(0.0f, tolinearindex, tolinearindex, tolinearindex);
+	const __m128 alphamask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	int next = 0;
+	for(int i=0; i<GRADIENT_RAMP_SIZE; i++) {
+		const float *c0, *c1;
+		float f = stops_for(r, i, next, c0, c1);
+		__m128 v0 = _mm_load_ps(c0);
+		__m128 v = _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(c1), v0), _mm_set1_ps(f)));
+		if(r.linear) {
+			alignas(16) int32_t index[4];
+			_mm_store_si128((__m128i*)index, _mm_cvtps_epi32(_mm_mul_ps(v, vindex)));
+			__m128 srgb = _mm_set_ps(0.0f, tosrgb[index[2]], tosrgb[index[1]], tosrgb[index[0]]);
+			v = _mm_or_ps(_mm_and_ps(alphamask, v), _mm_andnot_ps(alphamask, srgb));
+		}
+		v = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(v, vmult), vadd), vzero), vmax);
+		__m128 premultiply = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,3,3)), _mm_set1_ps(1.0f/255.0f));
+		v = _mm_or_ps(_mm_and_ps(alphamask, v), _mm_andnot_ps(alphamask, _mm_mul_ps(v, premultiply)));
+		__m128i packed = _mm_cvtps_epi32(v);
+		packed = _mm_packs_epi32(packed, packed);
+		int32_t pixel = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+		memcpy(ramp.texels+i*4, &pixel, 4);
+	}
+}
+#endif
+
+void SWF::bake_gradient_ramp(const Gradient &gradient, GradientRamp &ramp, const CXForm *cxform)
+{
+	RampStops r;
+	load_stops(gradient, cxform, r);
+	if(!r.count) {
+		memset(ramp.texels, 0, sizeof(ramp.texels));
+		return;
+	}
+#ifdef LIBSHOCKWAVE_SSE2
+	bake_sse2(r, ramp);
+#else
+	bake_scalar(r, ramp);
+#endif
+}
+
+void SWF::bake_gradient_ramp_scalar(const Gradient &gradient, GradientRamp &ramp, const CXForm *cxform)
+{
+	RampStops r;
+	load_stops(gradient, cxform, r);
+	if(!r.count) {
+		memset(ramp.texels, 0, sizeof(ramp.texels));
+		return;
+	}
+	bake_scalar(r, ramp);
+}
+
+
+
+bool GradientSpan::set(const FillStyle &style, const GradientRamp &r, float a, float b, float c, float d, float tx, float ty)
+{
+	ramp = r;
+	type = style.StyleType;
+	spread = static_cast<GradSpreadMode>(style.Gradient.SpreadMode);
+	focal = std::min(std::max(style.Gradient.FocalPoint, -0.998f), 0.998f);	// Keeps the focus inside the circle
+
+	// Unit square to output pixels, through the gradient matrix and then the placement
+	const Matrix &g = style.GradientMatrix;
+	const float half = coord_to_float(twips_to_coord(16384));
+	float ga = g.ScaleX*half, gb = g.RotateSkew0*half, gc = g.RotateSkew1*half, gd = g.ScaleY*half;
+	float gtx = coord_to_float(g.TranslateX), gty = coord_to_float(g.TranslateY);
+	float ma = a*ga + c*gb, mc = a*gc + c*gd, mtx = a*gtx + c*gty + tx;
+	float mb = b*ga + d*gb, md = b*gc + d*gd, mty = b*gtx + d*gty + ty;
+
+	float det = ma*md - mb*mc;
+	if(fabsf(det)<1e-12f)
+		return false;
+	float inv = 1.0f/det;
+	xx = md*inv;
+	xy = -mc*inv;
+	yx = -mb*inv;
+	yy = ma*inv;
+	x0 = -(xx*mtx + xy*mty);
+	y0 = -(yx*mtx + yy*mty);
+	return true;
+}
+
+void GradientSpan::fill(uint32_t x, uint32_t y, uint32_t count, uint8_t *out) const
+{
+	float px = x+0.5f, py = y+0.5f;
+	float gx = xx*px + xy*py + x0;
+	float gy = yx*px + yy*py + y0;
+	for(uint32_t i=0; i<count; i++, out+=4, gx+=xx, gy+=yx) {
+		float t;
+		switch(type) {
+		case FillStyle::Type::LINEARGRADIENT:
+			t = (gx+1.0f)*0.5f;
+			break;
+		case FillStyle::Type::FOCALRADIALGRADIENT: {
+			// Ratio along the ray from the focus through the point to the edge of the circle
+			float dx = gx-focal, dy = gy;
+			float aa = dx*dx + dy*dy;
+			float bb = focal*dx;
+			float cc = focal*focal - 1.0f;
+			t = aa/(sqrtf(bb*bb - aa*cc) - bb);
+			if(!(t==t))
+				t = 0.0f;	// The focus itself
+			break;
+		}
+		default:
+			t = sqrtf(gx*gx + gy*gy);
+			break;
+		}
+		switch(spread) {
+		case REPEAT:
+			t -= floorf(t);
+			break;
+		case REFLECT:
+			t -= 2.0f*floorf(t*0.5f);
+			if(t>1.0f)
+				t = 2.0f-t;
+			break;
+		default:
+			t = std::min(std::max(t, 0.0f), 1.0f);
+			break;
+		}
+		memcpy(out, ramp.texels+std::min((int)(t*(GRADIENT_RAMP_SIZE-1)+0.5f), GRADIENT_RAMP_SIZE-1)*4, 4);
+	}
+}
+
+
+
+GradientCache::GradientCache(Dictionary *d)
+{
+	dict = d;
+}
+
+const GradientRamp *GradientCache::find(uint64_t key, const FillStyle *style)
+{
+	if(!style || !is_gradient(*style))
+		return NULL;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<uint64_t,std::unique_ptr<GradientRamp> >::iterator found = ramps.find(key);
+		if(found!=ramps.end())
+			return found->second.get();
+	}
+
+	// Bake without holding the lock, so other lookups carry on meanwhile
+	std::unique_ptr<GradientRamp> ramp(new GradientRamp);
+	bake_gradient_ramp(style->Gradient, *ramp);
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unique_ptr<GradientRamp> &entry = ramps[key];
+	if(!entry)	// Otherwise another thread baked it first
+		entry = std::move(ramp);
+	return entry.get();
+}
+
+const GradientRamp *GradientCache::get_fill(uint16_t id, uint16_t style)
+{
+	FillStyleMap::iterator fills = dict->FillStyles.find(id);
+	if(fills==dict->FillStyles.end() || !style || style>fills->second.size())
+		return NULL;
+	return find((uint64_t(id)<<32) | style, &fills->second[style-1]);
+}
+
+const GradientRamp *GradientCache::get_line(uint16_t id, uint16_t style)
+{
+	LineStyleMap::iterator lines = dict->LineStyles.find(id);
+	if(lines==dict->LineStyles.end() || !style || style>lines->second.size() || !lines->second[style-1].HasFillFlag)
+		return NULL;
+	return find((uint64_t(id)<<32) | (1u<<16) | style, &lines->second[style-1].FillType);
+}
+
+void GradientCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	ramps.clear();
+}
+
+size_t GradientCache::size()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return ramps.size();
+}
+
+bool SWF::is_gradient(const FillStyle &style)
+{
+	return (style.StyleType==FillStyle::Type::LINEARGRADIENT ||
+		style.StyleType==FillStyle::Type::RADIALGRADIENT ||
+		style.StyleType==FillStyle::Type::FOCALRADIALGRADIENT);
+}
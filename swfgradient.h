@@ -0,0 +1,75 @@
+#ifndef LIBSHOCKWAVE_SWF_GRADIENT_H
+#define LIBSHOCKWAVE_SWF_GRADIENT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "swftypedefs.h"
+
+#define GRADIENT_RAMP_SIZE	256
+
+namespace SWF
+{
+
+	// A gradient baked to one premultiplied RGBA8 texel per ratio, so texel i is the colour at
+	// GradRecord ratio i. The layout is a 256x1 RGBA8 texture as it stands; sample it with
+	// linear filtering and clamp, repeat or mirrored repeat wrapping for the SpreadMode.
+	struct GradientRamp
+	{
+		alignas(16) uint8_t texels[GRADIENT_RAMP_SIZE*4];
+	};
+
+	// Interpolates straight colours between records, in sRGB or, for LINEAR_RGB, in linear light,
+	// then premultiplies. Ratios before the first record or after the last take its colour. If a
+	// CXForm is given it is applied to each interpolated colour before premultiplying.
+	void bake_gradient_ramp(const Gradient&, GradientRamp&, const CXForm *cxform=NULL);
+	void bake_gradient_ramp_scalar(const Gradient&, GradientRamp&, const CXForm *cxform=NULL);	// Without SIMD; gives the same bytes
+
+	// Fills spans of output pixels from a gradient fill style, for a CPU rasteriser
+	class GradientSpan
+	{
+		GradientRamp ramp;
+		float xx, xy, x0;	// Output pixel to the unit gradient square, [-1,1] on both axes
+		float yx, yy, y0;
+		FillStyle::Type type;
+		GradSpreadMode spread;
+		float focal;
+
+	public:
+		// a, b, c, d, tx and ty map character space to output pixels: x' = a*x + c*y + tx,
+		// y' = b*x + d*y + ty. Returns false if the gradient's matrix collapses it to a line.
+		bool set(const FillStyle&, const GradientRamp&, float a, float b, float c, float d, float tx, float ty);
+
+		// Writes count premultiplied RGBA8 pixels starting at (x,y), sampled at pixel centres
+		void fill(uint32_t x, uint32_t y, uint32_t count, uint8_t *out) const;
+	};
+
+	// Keeps one baked ramp per gradient fill style, keyed by character id and the 1-based style
+	// index used by Shape::fill0, fill1 and stroke. Ramps are baked on first use and live until
+	// clear(); the dictionary must not change while the cache is in use.
+	class GradientCache
+	{
+		Dictionary *dict;
+		std::mutex mutex;
+		std::unordered_map<uint64_t,std::unique_ptr<GradientRamp> > ramps;
+
+		const GradientRamp *find(uint64_t, const FillStyle*);
+
+	public:
+		GradientCache(Dictionary*);
+
+		// Return NULL if the style does not exist or is not a gradient
+		const GradientRamp *get_fill(uint16_t, uint16_t);
+		const GradientRamp *get_line(uint16_t, uint16_t);	// LineStyle2 with a gradient FillType
+		void clear();
+		size_t size();
+	};
+
+	bool is_gradient(const FillStyle&);
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_GRADIENT_H
@@ -0,0 +1,151 @@
+#include "swfmeshcache.h"
+#include "swfstroker.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+using namespace SWF;
+
+#define MESHCACHE_MIN_BUCKET	-64
+#define MESHCACHE_MAX_BUCKET	64
+
+static inline uint64_t cache_key(uint16_t id, int bucketx, int buckety, float tolerance)
+{
+	uint32_t tolerancebits;
+	memcpy(&tolerancebits, &tolerance, sizeof(tolerancebits));
+	return (uint64_t(id)<<48) | (uint64_t(uint8_t(bucketx))<<40) | (uint64_t(uint8_t(buckety))<<32) | tolerancebits;
+}
+
+static inline unsigned shard_for(uint64_t key)
+{
+	return (unsigned)((key*0x9E3779B97F4A7C15ull)>>60) % MESHCACHE_SHARDS;
+}
+
+MeshCache::MeshCache(Dictionary *d, size_t b)
+{
+	dict = d;
+	budget = b;
+	hits = 0;
+	misses = 0;
+	evictions = 0;
+}
+
+std::shared_ptr<const Mesh> MeshCache::get(uint16_t id, const Matrix &m, float tolerance)
+{
+	// Each axis is bucketed on its own, since non-scaling and hairline strokes depend on both lengths
+	int bucketx = scale_bucket(sqrtf(m.ScaleX*m.ScaleX + m.RotateSkew0*m.RotateSkew0));
+	int buckety = scale_bucket(sqrtf(m.RotateSkew1*m.RotateSkew1 + m.ScaleY*m.ScaleY));
+	uint64_t key = cache_key(id, bucketx, buckety, tolerance);
+	Shard &shard = shards[shard_for(key)];
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		std::unordered_map<uint64_t,std::list<Entry>::iterator>::iterator found = shard.entries.find(key);
+		if(found!=shard.entries.end()) {
+			shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+			hits++;
+			return found->second->mesh;
+		}
+	}
+	misses++;
+
+	// Tessellate without holding the shard, so other lookups carry on meanwhile
+	std::shared_ptr<const Mesh> mesh = build(id, bucketx, buckety, tolerance);
+	if(!mesh)
+		return mesh;
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	std::unordered_map<uint64_t,std::list<Entry>::iterator>::iterator found = shard.entries.find(key);
+	if(found!=shard.entries.end())	// Another thread built it first
+		return found->second->mesh;
+	Entry entry;
+	entry.key = key;
+	entry.bytes = mesh->get_bytes()+sizeof(Entry);
+	entry.mesh = mesh;
+	shard.lru.push_front(entry);
+	shard.entries[key] = shard.lru.begin();
+	shard.bytes += entry.bytes;
+	evict(shard);
+	return mesh;
+}
+
+std::shared_ptr<const Mesh> MeshCache::build(uint16_t id, int bucketx, int buckety, float tolerance)
+{
+	CharacterDict::iterator character = dict->CharacterList.find(id);
+	if(character==dict->CharacterList.end())
+		return std::shared_ptr<const Mesh>();
+	LineStyleMap::iterator lines = dict->LineStyles.find(id);
+
+	thread_local Tessellator tessellator;
+	thread_local Stroker stroker;
+	tessellator.set_tolerance(tolerance);
+	stroker.set_tolerance(tolerance);
+	Matrix m;
+	m.ScaleX = bucket_scale(bucketx);
+	m.ScaleY = bucket_scale(buckety);
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+	tessellate_character(tessellator, stroker, character->second, (lines!=dict->LineStyles.end()) ? &lines->second : NULL, *mesh, m);
+	return mesh;
+}
+
+void MeshCache::evict(Shard &shard)
+{
+	// Always keep the newest entry, even when it alone is over the shard's share
+	size_t limit = budget.load()/MESHCACHE_SHARDS;
+	while(shard.bytes>limit && shard.lru.size()>1) {
+		Entry &oldest = shard.lru.back();
+		shard.bytes -= oldest.bytes;
+		shard.entries.erase(oldest.key);
+		shard.lru.pop_back();
+		evictions++;
+	}
+}
+
+void MeshCache::clear()
+{
+	for(Shard &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.entries.clear();
+		shard.lru.clear();
+		shard.bytes = 0;
+	}
+}
+
+void MeshCache::set_budget(size_t b)
+{
+	budget = b;
+	for(Shard &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		evict(shard);
+	}
+}
+
+size_t MeshCache::get_bytes()
+{
+	size_t total = 0;
+	for(Shard &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		total += shard.bytes;
+	}
+	return total;
+}
+
+size_t MeshCache::get_entries()
+{
+	size_t total = 0;
+	for(Shard &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		total += shard.entries.size();
+	}
+	return total;
+}
+
+int MeshCache::scale_bucket(float scale)
+{
+	if(!(scale>0.0f))
+		return MESHCACHE_MIN_BUCKET;
+	int bucket = (int)ceilf(log2f(scale)*MESHCACHE_BUCKETS_PER_OCTAVE);
+	return std::min(std::max(bucket, MESHCACHE_MIN_BUCKET), MESHCACHE_MAX_BUCKET);
+}
+
+float MeshCache::bucket_scale(int bucket)
+{
+	return exp2f(float(bucket)/MESHCACHE_BUCKETS_PER_OCTAVE);	// The top of the bucket, so no scale in it gets too few segments
+}
@@ -0,0 +1,74 @@
+#ifndef LIBSHOCKWAVE_SWF_MESHCACHE_H
+#define LIBSHOCKWAVE_SWF_MESHCACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+#include "swftypedefs.h"
+#include "swftessellator.h"
+
+#define MESHCACHE_SHARDS	16
+#define MESHCACHE_BUCKETS_PER_OCTAVE	4
+
+namespace SWF
+{
+
+	// Keeps tessellated meshes per (character id, scale buckets, tolerance) so that placing the same
+	// symbol at about the same size again costs one hash lookup. The lengths of the placing Matrix's
+	// axes are each bucketed in quarter octaves and tessellated at the top of their bucket. Entries
+	// are spread over mutex-guarded shards, each with its own LRU list and a share of the byte
+	// budget. Meshes are handed out as shared_ptrs, so eviction never frees one still in use.
+	// The dictionary must not change while the cache is in use.
+	class MeshCache
+	{
+		struct Entry
+		{
+			uint64_t key;
+			size_t bytes;
+			std::shared_ptr<const Mesh> mesh;
+		};
+		struct Shard
+		{
+			std::mutex mutex;
+			std::list<Entry> lru;	// Most recently used first
+			std::unordered_map<uint64_t,std::list<Entry>::iterator> entries;
+			size_t bytes = 0;
+		};
+		Dictionary *dict;
+		std::atomic<size_t> budget;	// May change while lookups evict
+		Shard shards[MESHCACHE_SHARDS];
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> misses;
+		std::atomic<uint64_t> evictions;
+
+		std::shared_ptr<const Mesh> build(uint16_t, int, int, float);
+		void evict(Shard&);
+
+	public:
+		MeshCache(Dictionary*, size_t budget=64<<20);	// Budget in bytes of mesh data
+
+		// Returns the mesh for the character as placed by the matrix, tessellating it on a miss.
+		// The mesh is in character space. Returns NULL if the dictionary has no such character.
+		std::shared_ptr<const Mesh> get(uint16_t, const Matrix&, float tolerance=0.25f);
+		void clear();
+		void set_budget(size_t);
+		size_t get_budget() { return budget.load(); }
+		size_t get_bytes();
+		size_t get_entries();
+		uint64_t get_hits() { return hits; }
+		uint64_t get_misses() { return misses; }
+		uint64_t get_evictions() { return evictions; }
+		void reset_counters() { hits = misses = evictions = 0; }
+
+		static int scale_bucket(float);	// Bucket for the length of one axis
+		static float bucket_scale(int);
+	};
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_MESHCACHE_H
@@ -1,4 +1,6 @@
 #include "swfparser.h"
+#include "swfsource.h"
+#include "swfthreadpool.h"
 using namespace SWF;
 
 #include <cstdio>
@@ -9,11 +11,78 @@ using namespace SWF;
 #define _LZMA_PROB32
 #include "lzma/LzmaLib.h"
 #endif
+#if defined(__unix__) || defined(__APPLE__)
+#define LIBSHOCKWAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+Error Parser::parse_swf_file(const char *path, const char *password)
+{
+	if(swfstream) {	// The previous stream may still point into the previous file
+		delete swfstream;
+		swfstream = NULL;
+	}
+	close_file();
+
+	#ifdef LIBSHOCKWAVE_MMAP
+	int fd = open(path, O_RDONLY);
+	if(fd<0)
+		return Error::SWF_FILE_OPEN_ERROR;
+	struct stat filestat;
+	if(fstat(fd, &filestat)!=0 || filestat.st_size<Header::LENGTH || uint64_t(filestat.st_size)>UINT32_MAX) {
+		close(fd);
+		return Error::SWF_FILE_OPEN_ERROR;
+	}
+	void *mapping = mmap(NULL, filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping==MAP_FAILED)
+		return Error::SWF_FILE_OPEN_ERROR;
+	madvise(mapping, filestat.st_size, MADV_SEQUENTIAL);
+	filedata = (uint8_t*)mapping;
+	filelength = filestat.st_size;
+	#else
+	FILE *swffile = fopen(path, "rb");
+	if(swffile==NULL)
+		return Error::SWF_FILE_OPEN_ERROR;
+	fseek(swffile, 0, SEEK_END);
+	long len = ftell(swffile);
+	rewind(swffile);
+	if(len>=Header::LENGTH)
+		filedata = (uint8_t*)malloc(len);
+	if(!filedata || fread(filedata, len, 1, swffile)!=1) {
+		fclose(swffile);
+		close_file();
+		return Error::SWF_FILE_OPEN_ERROR;
+	}
+	fclose(swffile);
+	filelength = len;
+	#endif
+
+	return parse_swf_data(filedata, (uint32_t)filelength, password);
+}
+
+void Parser::close_file()
+{
+	if(!filedata)
+		return;
+	#ifdef LIBSHOCKWAVE_MMAP
+	munmap(filedata, filelength);
+	#else
+	free(filedata);
+	#endif
+	filedata = NULL;
+	filelength = 0;
+}
 
 Error Parser::parse_swf_data(uint8_t *data, uint32_t bytes, const char *password)
 {
 	if(!data)
 		return Error::SWF_NULL_DATA;
+	if(bytes<Header::LENGTH)
+		return Error::SWF_DATA_INVALID;
 
 	size_t datalength = (
 		data[Header::FILESIZE_32] |
@@ -25,8 +94,7 @@ Error Parser::parse_swf_data(uint8_t *data, uint32_t bytes, const char *password
 	if(data[Header::SIGNATURE+1] != 'W' || data[Header::SIGNATURE+2] != 'S')
 		return Error::SWF_DATA_INVALID;
 
-	if(swfstream) delete swfstream;
-
+	reset();
 	movieprops = new Properties();
 	movieprops->version = (data[Header::VERSION]);
 	switch(data[Header::SIGNATURE]) {
@@ -34,9 +102,15 @@ Error Parser::parse_swf_data(uint8_t *data, uint32_t bytes, const char *password
 	{
 		#ifndef LIBSHOCKWAVE_DISABLE_ZLIB
 		//if(data[Header::VERSION] < 6)	return Error::SWF_COMPRESSION_VERSION_MISMATCH;	// invalid if below SWF6
+		if((options.streaming || options.pipelined) && !options.lazy) {
+			swfstream = open_stream(new ZlibSource(&data[Header::LENGTH], bytes-Header::LENGTH), datalength);
+			break;
+		}
 		uLong zliblen = (uLong)(bytes-Header::LENGTH);
 		uint8_t *swfdecompressed = (uint8_t*)malloc(datalength);
 		int zliberror = uncompress2(swfdecompressed, (uLong*)&datalength, &data[Header::LENGTH], &zliblen);
+		if(zliberror<0)	// Each of the errors returned below
+			free(swfdecompressed);
 		switch(zliberror) {
 			case Z_ERRNO:			return Error::ZLIB_ERRNO;
 			case Z_STREAM_ERROR:	return Error::ZLIB_STREAM_ERROR;
@@ -45,7 +119,7 @@ Error Parser::parse_swf_data(uint8_t *data, uint32_t bytes, const char *password
 			case Z_BUF_ERROR:		return Error::ZLIB_BUFFER_ERROR;
 			case Z_VERSION_ERROR:	return Error::ZLIB_VERSION_ERROR;
 		}
-		swfstream = new Stream(swfdecompressed, datalength);
+		swfstream = new Stream(swfdecompressed, datalength, true);
 		break;
 		#else
 		return Error::ZLIB_NOT_COMPILED;
@@ -55,64 +129,219 @@ Error Parser::parse_swf_data(uint8_t *data, uint32_t bytes, const char *password
 	{
 		#ifndef LIBSHOCKWAVE_DISABLE_LZMA
 		//if(data[Header::VERSION] < 13)	return Error::SWF_COMPRESSION_VERSION_MISMATCH;	// invalid if below SWF13
+		uint32_t lzmaoffset = Header::LZMA_LENGTH+LZMA_PROPS_SIZE;
+		if(bytes<lzmaoffset)	// The compressed length and LZMA properties follow the header
+			return Error::LZMA_UNEXPECTED_EOF;
 		size_t lzmalen =
 			data[Header::LENGTH] |
 			data[Header::LENGTH+1]<<8 |
 			data[Header::LENGTH+2]<<16 |
 			data[Header::LENGTH+3]<<24;
+		if(lzmalen>bytes-lzmaoffset)	lzmalen = bytes-lzmaoffset;
+		if((options.streaming || options.pipelined) && !options.lazy) {
+			swfstream = open_stream(new LzmaSource(&data[Header::LZMA_LENGTH], &data[lzmaoffset], lzmalen, datalength), datalength);
+			break;
+		}
 		uint8_t *swfdecompressed = (uint8_t*)malloc(datalength);
-		SRes lzmaerror = LzmaUncompress(swfdecompressed, &datalength, &data[Header::LZMA_LENGTH+LZMA_PROPS_SIZE], &lzmalen, &data[Header::LZMA_LENGTH], LZMA_PROPS_SIZE);
+		SRes lzmaerror = LzmaUncompress(swfdecompressed, &datalength, &data[lzmaoffset], &lzmalen, &data[Header::LZMA_LENGTH], LZMA_PROPS_SIZE);
+		if(lzmaerror==SZ_ERROR_DATA || lzmaerror==SZ_ERROR_MEM || lzmaerror==SZ_ERROR_UNSUPPORTED || lzmaerror==SZ_ERROR_INPUT_EOF)
+			free(swfdecompressed);
 		switch(lzmaerror) {
 			case SZ_ERROR_DATA:			return Error::LZMA_DATA_ERROR;
 			case SZ_ERROR_MEM:			return Error::LZMA_MEM_ALLOC_ERROR;
 			case SZ_ERROR_UNSUPPORTED:	return Error::LZMA_INVALID_PROPS;
 			case SZ_ERROR_INPUT_EOF:	return Error::LZMA_UNEXPECTED_EOF;
 		}
-		swfstream = new Stream(swfdecompressed, datalength);
+		swfstream = new Stream(swfdecompressed, datalength, true);
 		break;
 		#else
 		return Error::LZMA_NOT_COMPILED;
 		#endif
 	}
-	default:	// no compression
+	default:	// no compression, so read straight from the caller's buffer or file mapping
+		if(datalength>bytes-Header::LENGTH)
+			datalength = bytes-Header::LENGTH;
 		swfstream = new Stream(&data[Header::LENGTH], datalength);
 	}
+	dictionary = swfstream->get_dict();	// Owned from here, so it is freed even if the header fails
 
 	movieprops->dimensions = swfstream->readRECT();
 	movieprops->framerate = swfstream->readFIXED8();
 	movieprops->framecount = swfstream->readUI16();
+	if(swfstream->get_error()!=Error::OK)
+		return swfstream->get_error();
+
+	if(options.lazy)
+		return this->index_tags(swfstream);
+
+	Error error = this->tag_loop(swfstream, DisplayList(), options.frame_limit, options.tags);
+	swfstream->close_source();	// Stops the decompressor thread early if parsing failed
+	return error;
+}
 
-	return this->tag_loop(swfstream);
+// Frees everything the last parse produced; pointers from get_dict() and get_properties() go with it
+void Parser::reset()
+{
+	if(swfstream) {
+		delete swfstream;
+		swfstream = NULL;
+	}
+	if(dictionary) {
+		delete dictionary;
+		dictionary = NULL;
+	}
+	if(movieprops) {
+		delete movieprops;
+		movieprops = NULL;
+	}
+	tagindex.clear();
+	characterindex.clear();
+}
+
+static bool defines_character(uint16_t tag)
+{
+	switch(tag) {
+		case TagType::DefineShape:			case TagType::DefineShape2:			case TagType::DefineShape3:
+		case TagType::DefineShape4:			case TagType::DefineMorphShape:		case TagType::DefineMorphShape2:
+		case TagType::DefineBits:			case TagType::DefineBitsJPEG2:		case TagType::DefineBitsJPEG3:
+		case TagType::DefineBitsJPEG4:		case TagType::DefineBitsLossless:	case TagType::DefineBitsLossless2:
+		case TagType::DefineButton:			case TagType::DefineButton2:		case TagType::DefineSprite:
+		case TagType::DefineFont:			case TagType::DefineFont2:			case TagType::DefineFont3:
+		case TagType::DefineFont4:			case TagType::DefineText:			case TagType::DefineText2:
+		case TagType::DefineEditText:		case TagType::DefineSound:			case TagType::DefineVideoStream:
+		case TagType::DefineBinaryData:
+			return true;
+	}
+	return false;
 }
 
-Error Parser::tag_loop(Stream *swfstream)
+Error Parser::index_tags(Stream *swfstream)
 {
-	DisplayList currentdisplaystack;
 	dictionary = swfstream->get_dict();
+	dictionary->Frames.set_keyframe_interval(options.keyframe_interval);
 
+	size_t framecounter = 0;
+	dictionary->Frames.set_frame_offset(framecounter, swfstream->get_pos());
 	RecordHeader rh = swfstream->readRECORDHEADER();
-	uint16_t framecounter = 0;
-	while(rh.tag != TagType::End) {
-		switch(rh.tag) {
+	while(rh.tag != TagType::End && swfstream->get_error()==Error::OK) {
+		if(rh.length > swfstream->get_length()-swfstream->get_pos())
+			return Error::SWF_DATA_INVALID;
+		if(rh.tag==TagType::Protect && rh.length>0)
+			return Error::SWF_FILE_ENCRYPTED;
+		TagIndexEntry entry;
+		entry.tag = rh.tag;
+		entry.offset = swfstream->get_pos();
+		entry.length = rh.length;
+		if(rh.length>=2 && defines_character(rh.tag)) {
+			entry.characterid = swfstream->readUI16();
+			characterindex[entry.characterid] = tagindex.size();
+		}
+		if(rh.tag==TagType::SetBackgroundColor)	// The only header tag Properties keeps; FileAttributes holds nothing it stores
+			movieprops->bgcolour = swfstream->readRGB();
+		tagindex.push_back(entry);
+		swfstream->seek(entry.offset+entry.length);
+		if(rh.tag==TagType::ShowFrame)
+			dictionary->Frames.set_frame_offset(++framecounter, swfstream->get_pos());
+		rh = swfstream->readRECORDHEADER();
+	}
+	return swfstream->get_error();
+}
+
+Error Parser::decode_frames(uint16_t count)
+{
+	if(!dictionary || !swfstream)
+		return Error::SWF_NULL_DATA;
+	if((options.streaming || options.pipelined) && !options.lazy)	// The stream was consumed by the first pass
+		return Error::SWF_DATA_INVALID;
+	Timeline &frames = dictionary->Frames;
+	if(frames.size()>=frames.get_frame_offset_count())
+		return Error::OK;
+
+	DisplayList displaylist;
+	if(!frames.empty())
+		displaylist = frames.get_frame(frames.size()-1);
+	swfstream->seek(frames.get_frame_offset(frames.size()));
+	return this->tag_loop(swfstream, displaylist, count, options.lazy ? TagFilter::timeline_only() : options.tags);
+}
+
+Character *Parser::get_character(uint16_t id)
+{
+	if(!dictionary)
+		return NULL;
+	CharacterDict::iterator character = dictionary->CharacterList.find(id);
+	if(character!=dictionary->CharacterList.end())
+		return &character->second;
+	if(!options.lazy || !swfstream)
+		return NULL;
+
+	IdTable<size_t>::iterator entry = characterindex.find(id);
+	if(entry==characterindex.end())
+		return NULL;
+	TagIndexEntry &tag = tagindex[entry->second];
+	if(tag.decoded)	// Decoding again would only append its styles a second time
+		return NULL;
+	tag.decoded = true;
+	switch(tag.tag) {
+		case TagType::DefineShape:
+		case TagType::DefineShape2:
+		case TagType::DefineShape3:
+		case TagType::DefineShape4:
+			swfstream->seek(tag.offset);
+			swfstream->readDEFINESHAPE(tag.tag);
+			break;
+	}
+	character = dictionary->CharacterList.find(id);
+	return (character!=dictionary->CharacterList.end()) ? &character->second : NULL;
+}
+
+Stream *Parser::open_stream(InputSource *source, uint32_t datalength)
+{
+	if(options.pipelined)
+		source = new PipelineSource(source, options.pipeline_buffer);
+	return new Stream(source, datalength, options.stream_window);
+}
+
+static inline void add_display_change(std::vector<DisplayChange> &changes, DisplayChange::Type type, uint16_t depth, const DisplayList &displaylist)
+{
+	DisplayChange change;
+	change.ChangeType = type;
+	change.depth = depth;
+	if(type!=DisplayChange::Type::REMOVE)
+		change.character = displaylist.at(depth);
+	changes.push_back(change);
+}
+
+Error Parser::tag_loop(Stream *swfstream, DisplayList currentdisplaystack, uint16_t framelimit, const TagFilter &tags)
+{
+	std::vector<DisplayChange> framechanges;
+	dictionary = swfstream->get_dict();
+	dictionary->Frames.set_keyframe_interval(options.keyframe_interval);	// Ignored once frames exist
+
+	bool deferredshapes = (options.shape_threads>0 && !swfstream->is_streaming());
+	TagIndex shapetags;
+
+	uint32_t framestart = swfstream->get_pos();
+	RecordHeader rh = swfstream->readRECORDHEADER();
+	size_t framecounter = 0;
+	while(rh.tag != TagType::End && swfstream->get_error()==Error::OK) {
+		if(rh.length > swfstream->get_length()-swfstream->get_pos())
+			return Error::SWF_DATA_INVALID;
+		uint32_t tagend = swfstream->get_pos()+rh.length;
+		switch(tags.test(rh.tag) ? rh.tag : (uint16_t)TagType::End) {	// Filtered tags match no case and are skipped
 			case TagType::DefineShape:
 			case TagType::DefineShape2:
 			case TagType::DefineShape3:
-			{
-				uint16_t characterid = swfstream->readUI16();
-				Rect shapebounds = swfstream->readRECT();
-				swfstream->readSHAPEWITHSTYLE(characterid, shapebounds, rh.tag);
-				break;
-			}
 			case TagType::DefineShape4:
 			{
-				uint16_t characterid = swfstream->readUI16();
-				Rect shapebounds = swfstream->readRECT();
-				Rect edgebounds = swfstream->readRECT();
-				swfstream->readUB(5);	// Reserved
-				bool usesfillwindingrule = swfstream->readUB(1);
-				bool usesnonscalingstrokes = swfstream->readUB(1);
-				bool usesscalingstrokes = swfstream->readUB(1);
-				swfstream->readSHAPEWITHSTYLE(characterid, shapebounds, rh.tag);
+				if(!deferredshapes) {
+					swfstream->readDEFINESHAPE(rh.tag);
+					break;
+				}
+				TagIndexEntry entry;
+				entry.tag = rh.tag;
+				entry.offset = swfstream->get_pos();
+				entry.length = rh.length;
+				shapetags.push_back(entry);
 				break;
 			}
 			case TagType::PlaceObject:
@@ -126,21 +355,21 @@ Error Parser::tag_loop(Stream *swfstream)
 				if((rh.length-readlength)>0)
 					colourxform = swfstream->readCXFORM();
 
+				DisplayChange::Type changetype = DisplayChange::Type::MODIFY;
 				if(currentdisplaystack[depth].id!=characterid) {
 					DisplayChar character;
 					character.id = characterid;
 					currentdisplaystack[depth] = character;
+					changetype = DisplayChange::Type::PLACE;
 				}
 				currentdisplaystack[depth].transform = matrix;
 				currentdisplaystack[depth].colourtransform = colourxform;
-
+				add_display_change(framechanges, changetype, depth, currentdisplaystack);
 				break;
 			}
 			case TagType::PlaceObject2:
 			case TagType::PlaceObject3:
 			{
-				int readlength = swfstream->get_pos();
-
 				bool placeflaghasclipactions = swfstream->readUB(1);
 				bool placeflaghasclipdepth = swfstream->readUB(1);
 				bool placeflaghasname = swfstream->readUB(1);
@@ -191,9 +420,8 @@ Error Parser::tag_loop(Stream *swfstream)
 				}
 				if(placeflaghasmatrix)			currentdisplaystack[depth].transform = matrix;
 				if(placeflaghascolourtransform)	currentdisplaystack[depth].colourtransform = colourxform;
-
-				readlength = (swfstream->get_pos()-readlength);
-				if((rh.length-readlength)>0)	swfstream->readBytesAligned(rh.length-readlength);
+				if(placeflaghascharacter || placeflaghasmatrix || placeflaghascolourtransform)
+					add_display_change(framechanges, placeflaghascharacter ? DisplayChange::Type::PLACE : DisplayChange::Type::MODIFY, depth, currentdisplaystack);
 				break;
 			}
 			case TagType::RemoveObject:
@@ -203,6 +431,7 @@ Error Parser::tag_loop(Stream *swfstream)
 				if(rh.tag==TagType::RemoveObject)	characterid = swfstream->readUI16();
 				uint16_t depth = swfstream->readUI16();
 				currentdisplaystack.erase(depth);
+				add_display_change(framechanges, DisplayChange::Type::REMOVE, depth, currentdisplaystack);
 				break;
 			}
 			case TagType::DefineSceneAndFrameLabelData:
@@ -242,8 +471,6 @@ Error Parser::tag_loop(Stream *swfstream)
 				getbits = swfstream->readBits(1);			// SWFFlagsNoCrossDomainCache
 				getbits = swfstream->readBits(1);			// Reserved
 				getbits = swfstream->readBits(1);			// UseNetwork
-				for(int i=1; i<rh.length; i++)				// Reserved bytes
-					getbits = swfstream->readUI8();
 				break;
 			}
 			case TagType::Protect:
@@ -260,29 +487,191 @@ Error Parser::tag_loop(Stream *swfstream)
 				break;
 			}
 			case TagType::ShowFrame:
-				dictionary->Frames.push_back(currentdisplaystack);
-				framecounter++;
-			default:
-				swfstream->readBytesAligned(rh.length);
+				dictionary->Frames.set_frame_offset(dictionary->Frames.size(), framestart);
+				dictionary->Frames.add_frame(framechanges, currentdisplaystack);
+				framechanges.clear();
+				break;
+		}
+		swfstream->seek(tagend);	// Skips unhandled tags and anything a handler left unread
+		if(rh.tag==TagType::ShowFrame) {
+			framestart = tagend;
+			if(framelimit && ++framecounter==framelimit) {	// 0 means no limit
+				dictionary->Frames.set_frame_offset(dictionary->Frames.size(), framestart);	// Where decode_frames resumes
+				break;
+			}
 		}
 		rh = swfstream->readRECORDHEADER();
 	}
-	return Error::OK;
+	if(swfstream->get_error()!=Error::OK)
+		return swfstream->get_error();
+	return this->decode_shapes(swfstream, shapetags);
+}
+
+Error Parser::decode_shapes(Stream *swfstream, const TagIndex &shapetags)
+{
+	struct DecodedShape
+	{
+		uint16_t id = 0;
+		bool hascharacter = false;
+		Character character;
+		FillStyleArray fills;
+		LineStyleArray lines;
+	};
+
+	if(shapetags.empty())	// Nothing was deferred, as when shape_threads is 0 and the tag loop decoded them in order
+		return Error::OK;
+
+	// Every worker reads through its own stream and dictionary, so bit and style state stay private
+	ThreadPool pool(options.shape_threads);
+	std::vector<Stream*> readers(pool.size(), NULL);
+	std::vector<DecodedShape> decoded(shapetags.size());
+	pool.parallel_for(shapetags.size(), [&](size_t i, unsigned worker) {
+		if(!readers[worker])
+			readers[worker] = swfstream->duplicate();
+		Stream *reader = readers[worker];
+		Dictionary *dict = reader->get_dict();
+		DecodedShape &shape = decoded[i];
+		reader->seek(shapetags[i].offset);
+		shape.id = reader->readUI16();
+		reader->seek(shapetags[i].offset);
+		reader->readDEFINESHAPE(shapetags[i].tag);
+
+		CharacterDict::iterator character = dict->CharacterList.find(shape.id);
+		if(character!=dict->CharacterList.end()) {
+			shape.hascharacter = true;
+			shape.character = std::move(character->second);
+			dict->CharacterList.erase(character);
+		}
+		FillStyleMap::iterator fills = dict->FillStyles.find(shape.id);
+		if(fills!=dict->FillStyles.end()) {
+			shape.fills.swap(fills->second);
+			dict->FillStyles.erase(fills);
+		}
+		LineStyleMap::iterator lines = dict->LineStyles.find(shape.id);
+		if(lines!=dict->LineStyles.end()) {
+			shape.lines.swap(lines->second);
+			dict->LineStyles.erase(lines);
+		}
+	});
+
+	Error error = Error::OK;
+	for(size_t i=0; i<readers.size(); i++) {
+		if(!readers[i])
+			continue;
+		if(error==Error::OK)
+			error = readers[i]->get_error();
+		delete readers[i]->get_dict();
+		delete readers[i];
+	}
+
+	// Merge in file order, so the result matches a serial parse
+	for(size_t i=0; i<decoded.size(); i++) {
+		DecodedShape &shape = decoded[i];
+		if(!shape.fills.empty()) {
+			FillStyleArray &fills = dictionary->FillStyles[shape.id];
+			fills.insert(fills.end(), shape.fills.begin(), shape.fills.end());
+		}
+		if(!shape.lines.empty()) {
+			LineStyleArray &lines = dictionary->LineStyles[shape.id];
+			lines.insert(lines.end(), shape.lines.begin(), shape.lines.end());
+		}
+		if(shape.hascharacter)
+			dictionary->CharacterList[shape.id] = std::move(shape.character);
+	}
+	return error;
 }
 
 
 
-Stream::Stream(uint8_t *d, uint32_t len)
+Stream::Stream(uint8_t *d, uint32_t len, bool owned)
 {
 	assert(d!=NULL);
 	data = d;
-	datalength = len;
-	rewind();
-	reset_bits_pending();
+	ownsdata = owned;
+	datalength = streamlength = len;
+	dataoffset = pos = 0;
+	source = NULL;
+	windowsize = 0;
+	error = Error::OK;
+	bitbuffer = 0;
+	bits_pending = 0;
+
+	dict = new Dictionary();
+}
+
+Stream::Stream(InputSource *src, uint32_t len, uint32_t window)
+{
+	assert(src!=NULL);
+	source = src;
+	ownsdata = false;	// The window is freed by close_source()
+	windowsize = (window>64) ? window : 64;
+	data = (uint8_t*)malloc(windowsize);
+	streamlength = len;
+	datalength = dataoffset = pos = 0;
+	error = source->get_error();
+	bitbuffer = 0;
+	bits_pending = 0;
 
 	dict = new Dictionary();
 }
 
+Stream *Stream::duplicate()
+{
+	assert(source==NULL);	// Only data that is held in full can be read from several places at once
+	return new Stream(data, streamlength);
+}
+
+Stream::~Stream()
+{
+	close_source();
+	if(ownsdata)
+		free(data);
+}
+
+void Stream::close_source()
+{
+	if(!source)
+		return;
+	delete source;
+	source = NULL;
+	free(data);
+	data = NULL;
+	dataoffset += pos;
+	datalength = pos = 0;
+}
+
+bool Stream::refill()
+{
+	if(!source || error!=Error::OK)
+		return false;
+	uint32_t keep = (pos<8) ? pos : 8;	// Bytes still held in the bit buffer may be given back
+	uint32_t remaining = datalength-pos+keep;
+	memmove(data, &data[pos-keep], remaining);
+	dataoffset += pos-keep;
+	pos = keep;
+	datalength = remaining + (uint32_t)source->read(&data[remaining], windowsize-remaining);
+	if(source->get_error()!=Error::OK)
+		error = source->get_error();
+	return datalength>remaining;
+}
+
+void Stream::seek(uint32_t s)
+{
+	reset_bits_pending();
+	if(s<dataoffset || s>streamlength) {	// Past the end, or behind a streaming window that was discarded
+		error = Error::SWF_DATA_INVALID;
+		return;
+	}
+	while(s-dataoffset>datalength) {
+		pos = datalength;
+		if(!refill()) {
+			if(error==Error::OK)	error = Error::SWF_UNEXPECTED_EOF;
+			return;
+		}
+	}
+	pos = s-dataoffset;
+}
+
 RecordHeader inline Stream::readRECORDHEADER()
 {
 	RecordHeader rh;
@@ -304,12 +693,12 @@ FillStyle inline Stream::readFILLSTYLE(uint16_t tag)
 		break;
 	case FillStyle::Type::LINEARGRADIENT:
 	case FillStyle::Type::RADIALGRADIENT:
-		readMATRIX();
-		readGRADIENT(tag);
+		fs.GradientMatrix = readMATRIX();
+		static_cast<Gradient&>(fs.Gradient) = readGRADIENT(tag);
 		break;
 	case FillStyle::Type::FOCALRADIALGRADIENT:
-		readMATRIX();
-		readFOCALGRADIENT(tag);
+		fs.GradientMatrix = readMATRIX();
+		fs.Gradient = readFOCALGRADIENT(tag);
 		break;
 	case FillStyle::Type::REPEATINGBITMAP:
 	case FillStyle::Type::CLIPPEDBITMAP:
@@ -335,7 +724,7 @@ uint16_t inline Stream::readFILLSTYLEARRAY(uint16_t characterid, uint16_t tag)
 LineStyle inline Stream::readLINESTYLE(uint16_t tag)
 {
 	LineStyle ls;
-	ls.Width = readUI16() / 20.0f;
+	ls.Width = twips_to_coord(readUI16());
 	if(tag>=TagType::DefineShape3)	ls.Color = readRGBA();
 	else							ls.Color = readRGB();
 	ls.StartCapStyle = ls.EndCapStyle = LineStyle::Cap::ROUND;
@@ -348,7 +737,7 @@ LineStyle inline Stream::readLINESTYLE(uint16_t tag)
 LineStyle inline Stream::readLINESTYLE2(uint16_t tag)
 {
 	LineStyle ls;
-	ls.Width = readUI16() / 20.0f;
+	ls.Width = twips_to_coord(readUI16());
 	ls.StartCapStyle = static_cast<LineStyle::Cap>(readUB(2));
 	ls.JoinStyle = static_cast<LineStyle::Join>(readUB(2));
 	ls.HasFillFlag = readUB(1);
@@ -379,7 +768,25 @@ uint16_t inline Stream::readLINESTYLEARRAY(uint16_t characterid, uint16_t tag)
 	return stylecount;
 }
 
-void inline Stream::readSHAPEWITHSTYLE(uint16_t characterid, Rect bounds, uint16_t tag)
+void inline Stream::readDEFINESHAPE(uint16_t tag)
+{
+	uint16_t characterid = readUI16();
+	Rect shapebounds = readRECT();
+	FillRule fillrule = FillRule::EVEN_ODD;
+	if(tag==TagType::DefineShape4) {
+		Rect edgebounds = readRECT();
+		reset_bits_pending();	// The flags start on a fresh byte after the RECT
+		readUB(5);	// Reserved
+		bool usesfillwindingrule = readUB(1);
+		bool usesnonscalingstrokes = readUB(1);
+		bool usesscalingstrokes = readUB(1);
+		if(usesfillwindingrule)
+			fillrule = FillRule::NON_ZERO;
+	}
+	readSHAPEWITHSTYLE(characterid, shapebounds, tag, fillrule);
+}
+
+void inline Stream::readSHAPEWITHSTYLE(uint16_t characterid, Rect bounds, uint16_t tag, FillRule fillrule)
 {
 	uint16_t fillbase = 0;	// Offsets for when new fill styles are found mid-shape
 	uint16_t linebase = 0;
@@ -394,6 +801,8 @@ void inline Stream::readSHAPEWITHSTYLE(uint16_t characterid, Rect bounds, uint16
 	Character character;
 	Shape shape;
 	Point penlocation;
+	std::vector<Vertex> &vertices = vertexscratch;	// Reused between characters, then packed once into the character's pool
+	vertices.clear();
 	while(!(typeflag==0x00 && stateflags==0x00)) {
 		if(typeflag) {
 			Vertex v = readSHAPERECORDedge((stateflags&0x10) ? ShapeRecordType::STRAIGHTEDGE : ShapeRecordType::CURVEDEDGE, (stateflags&0x0F)+2);
@@ -401,18 +810,13 @@ void inline Stream::readSHAPEWITHSTYLE(uint16_t characterid, Rect bounds, uint16
 			v.anchor.y += penlocation.y;
 			v.control.x += penlocation.x;
 			v.control.y += penlocation.y;
-			shape.vertices.push_back(v);
+			vertices.push_back(v);
+			shape.count++;
 			penlocation.x = v.anchor.x;
 			penlocation.y = v.anchor.y;
 		} else {
 			StyleChangeRecord change = readSHAPERECORDstylechange(characterid, tag, stateflags);
-			if(shape.vertices.size()>1) {
-				shape.closed = (
-					int32_t(round(shape.vertices.front().anchor.x*20.0f))==int32_t(round(shape.vertices.back().anchor.x*20.0f)) &&
-					int32_t(round(shape.vertices.front().anchor.y*20.0f))==int32_t(round(shape.vertices.back().anchor.y*20.0f))
-					);
-				character.shapes.push_back(shape);
-			}
+			end_shape(character, shape);
 			if(change.NewStylesFlag) {
 				fillbase = this->dict->FillStyles[characterid].size()-change.NumNewFillStyles;
 				linebase = this->dict->LineStyles[characterid].size()-change.NumNewLineStyles;
@@ -422,7 +826,6 @@ void inline Stream::readSHAPEWITHSTYLE(uint16_t characterid, Rect bounds, uint16
 				penlocation.x = change.MoveDeltaX;
 				penlocation.y = change.MoveDeltaY;
 			}
-			shape.vertices.clear();
 			Vertex v;
 			v.anchor = penlocation;
 			if(change.FillStyle0Flag)
@@ -431,22 +834,36 @@ void inline Stream::readSHAPEWITHSTYLE(uint16_t characterid, Rect bounds, uint16
 				shape.fill1 = (change.FillStyle1 + fillbase);
 			if(change.LineStyleFlag)
 				shape.stroke = (change.LineStyle + linebase);
-			shape.vertices.push_back(v);
+			vertices.push_back(v);
+			shape.count++;
 		}
 		typeflag = readUB(1);
 		stateflags = readUB(5);
 	}
-	if(shape.vertices.size()>1) {
+	end_shape(character, shape);
+	if(!character.is_empty()) {
+		character.bounds = bounds;
+		character.fillrule = fillrule;
+		character.vertices.assign(vertices);
+		dict->CharacterList[characterid] = std::move(character);
+	}
+}
+
+void inline Stream::end_shape(Character &character, Shape &shape)
+{
+	if(shape.count>1) {
+		const Vertex &front = vertexscratch[shape.offset];
+		const Vertex &back = vertexscratch.back();
 		shape.closed = (
-			int32_t(round(shape.vertices.front().anchor.x*20.0f))==int32_t(round(shape.vertices.back().anchor.x*20.0f)) &&
-			int32_t(round(shape.vertices.front().anchor.y*20.0f))==int32_t(round(shape.vertices.back().anchor.y*20.0f))
+			coord_to_twips(front.anchor.x)==coord_to_twips(back.anchor.x) &&
+			coord_to_twips(front.anchor.y)==coord_to_twips(back.anchor.y)
 			);
 		character.shapes.push_back(shape);
+	} else {
+		vertexscratch.resize(shape.offset);	// Runs without an edge are dropped
 	}
-	if(!character.is_empty()) {
-		character.bounds = bounds;
-		dict->CharacterList[characterid] = character;
-	}
+	shape.offset = (uint32_t)vertexscratch.size();
+	shape.count = 0;
 }
 
 Gradient inline Stream::readGRADIENT(uint16_t tag)
@@ -455,9 +872,9 @@ Gradient inline Stream::readGRADIENT(uint16_t tag)
 	Gradient g;
 	g.SpreadMode = readUB(2);
 	g.InterpolationMode = readUB(2);
-	uint8_t numgrads = readUB(4);
-	for(int i=0; i<numgrads; i++)
-		g.GradientRecords.push_back(readGRADRECORD(tag));
+	g.NumGradients = readUB(4);
+	for(int i=0; i<g.NumGradients; i++)
+		g.GradientRecords[i] = readGRADRECORD(tag);
 	return g;
 }
 
@@ -467,9 +884,9 @@ FocalGradient inline Stream::readFOCALGRADIENT(uint16_t tag)
 	FocalGradient fg;
 	fg.SpreadMode = readUB(2);
 	fg.InterpolationMode = readUB(2);
-	uint8_t numgrads = readUB(4);
-	for(int i=0; i<numgrads; i++)
-		fg.GradientRecords.push_back(readGRADRECORD(tag));
+	fg.NumGradients = readUB(4);
+	for(int i=0; i<fg.NumGradients; i++)
+		fg.GradientRecords[i] = readGRADRECORD(tag);
 	fg.FocalPoint = readFIXED8();
 	return fg;
 }
@@ -489,8 +906,8 @@ StyleChangeRecord inline Stream::readSHAPERECORDstylechange(uint16_t characterid
 
 	if(stateflags&0x01) {				// StateMoveTo
 		uint8_t movebits = readUB(5);
-		r.MoveDeltaX = (readSB(movebits)/20.0f);
-		r.MoveDeltaY = (readSB(movebits)/20.0f);
+		r.MoveDeltaX = twips_to_coord(readSB(movebits));
+		r.MoveDeltaY = twips_to_coord(readSB(movebits));
 		r.MoveDeltaFlag = true;
 	}
 
@@ -526,23 +943,23 @@ Vertex inline Stream::readSHAPERECORDedge(ShapeRecordType type, uint8_t numbits)
 		{
 			Vertex delta;
 			if(readUB(1)) {		// GeneralLineFlag
-				delta.anchor.x = delta.control.x = (readSB(numbits)/20.0f);
-				delta.anchor.y = delta.control.y = (readSB(numbits)/20.0f);
+				delta.anchor.x = delta.control.x = twips_to_coord(readSB(numbits));
+				delta.anchor.y = delta.control.y = twips_to_coord(readSB(numbits));
 			} else {
 				if(readUB(1))	// VertLineFlag
-					delta.anchor.y = delta.control.y = (readSB(numbits)/20.0f);
+					delta.anchor.y = delta.control.y = twips_to_coord(readSB(numbits));
 				else
-					delta.anchor.x = delta.control.x = (readSB(numbits)/20.0f);
+					delta.anchor.x = delta.control.x = twips_to_coord(readSB(numbits));
 			}
 			return delta;
 		}
 		case ShapeRecordType::CURVEDEDGE:
 		{
 			Vertex delta;
-			delta.control.x = (readSB(numbits)/20.0f);
-			delta.control.y = (readSB(numbits)/20.0f);
-			delta.anchor.x = delta.control.x + (readSB(numbits)/20.0f);
-			delta.anchor.y = delta.control.y + (readSB(numbits)/20.0f);
+			delta.control.x = twips_to_coord(readSB(numbits));
+			delta.control.y = twips_to_coord(readSB(numbits));
+			delta.anchor.x = delta.control.x + twips_to_coord(readSB(numbits));
+			delta.anchor.y = delta.control.y + twips_to_coord(readSB(numbits));
 			return delta;
 		}
 	}
@@ -672,10 +1089,10 @@ Rect inline Stream::readRECT()
 	reset_bits_pending();
 	uint8_t bits = readUB(5);
 	Rect rect;
-	rect.xmin = readSB(bits) / 20.0f;
-	rect.xmax = readSB(bits) / 20.0f;
-	rect.ymin = readSB(bits) / 20.0f;
-	rect.ymax = readSB(bits) / 20.0f;
+	rect.xmin = twips_to_coord(readSB(bits));
+	rect.xmax = twips_to_coord(readSB(bits));
+	rect.ymin = twips_to_coord(readSB(bits));
+	rect.ymax = twips_to_coord(readSB(bits));
 	return rect;
 }
 
@@ -726,8 +1143,8 @@ Matrix inline Stream::readMATRIX()
 		m.RotateSkew1 = readFB(bits);	// RotateSkew1
 	}
 	bits = readUB(5);					// NTranslateBits
-	m.TranslateX = readSB(bits)/20.0f;	// TranslateX
-	m.TranslateY = readSB(bits)/20.0f;	// TranslateY
+	m.TranslateX = twips_to_coord(readSB(bits));	// TranslateX
+	m.TranslateY = twips_to_coord(readSB(bits));	// TranslateY
 	return m;
 }
 
@@ -866,8 +1283,8 @@ const char inline *Stream::readSTRING()
 int32_t inline Stream::readSB(uint8_t bits)
 {
 	uint32_t readbits = readBits(bits);
-	if(readbits&(1<<(bits-1)))	readbits |= (0xFFFFFFFF<<bits);
-	return (int32_t)readbits;
+	uint32_t signbit = (uint32_t)((1ULL<<bits)>>1);
+	return (int32_t)((readbits^signbit)-signbit);
 }
 
 uint32_t inline Stream::readUB(uint8_t bits)
@@ -885,7 +1302,10 @@ float inline Stream::readFB(uint8_t bits)
 uint8_t inline Stream::readByte()
 {
 	reset_bits_pending();
-	assert(pos!=datalength);
+	if(pos==datalength && !refill()) {
+		if(error==Error::OK)	error = Error::SWF_UNEXPECTED_EOF;
+		return 0;
+	}
 	return data[pos++];
 }
 
@@ -905,34 +1325,53 @@ uint64_t inline Stream::readBytesAlignedBigEndian(uint8_t bytes)
 	return returnval;
 }
 
+static inline uint64_t load_big_endian_64(const uint8_t *p)
+{
+	uint64_t word;
+	memcpy(&word, p, sizeof(uint64_t));
+	#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+	return word;
+	#elif defined(__GNUC__) || defined(__clang__)
+	return __builtin_bswap64(word);
+	#elif defined(_MSC_VER)
+	return _byteswap_uint64(word);
+	#else
+	return	(uint64_t)p[0]<<56 | (uint64_t)p[1]<<48 | (uint64_t)p[2]<<40 | (uint64_t)p[3]<<32 |
+			(uint64_t)p[4]<<24 | (uint64_t)p[5]<<16 | (uint64_t)p[6]<<8 | (uint64_t)p[7];
+	#endif
+}
+
+void inline Stream::fill_bits()
+{
+	if(datalength-pos>=8) {
+		// Bits past the last whole byte taken are the same bits the next load brings in, so they can stay
+		bitbuffer |= load_big_endian_64(&data[pos])>>bits_pending;
+		uint8_t take = (63-bits_pending)>>3;
+		pos += take;
+		bits_pending += take<<3;
+		return;
+	}
+	while(bits_pending<=56) {
+		if(pos==datalength && !refill())
+			return;
+		bitbuffer |= (uint64_t)data[pos++]<<(56-bits_pending);
+		bits_pending += 8;
+	}
+}
+
 uint32_t inline Stream::readBits(uint8_t bits)
 {
 	if(bits==0)	return 0;
-	if((bits%8)==0 && bits_pending==0)	return readBytesAlignedBigEndian(bits/8);
-	
-	uint32_t returnval = 0;
-	while(bits>0) {
-		if(bits_pending > 0) {
-			uint8_t take = (uint8_t)fmin(bits_pending, bits);
-			if(bits_pending==take) {
-				returnval = (returnval<<take) | partial_byte;
-				partial_byte = 0;
-			} else {
-				uint8_t mask = bitmasks[take];
-				uint8_t remainmask = bitmasks[bits_pending-take];
-				uint8_t taken = ( ( partial_byte >> (bits_pending - take) ) & mask );
-				returnval = (returnval<<take) | taken;
-				partial_byte = partial_byte & remainmask;
-			}
-			if(take==bits_pending)	partial_byte = 0;
-			bits_pending -= take;
-			bits -= take;
-			continue;
+	if(bits_pending<bits) {
+		fill_bits();
+		if(bits_pending<bits) {	// Out of data; the missing bits read as zero
+			if(error==Error::OK)	error = Error::SWF_UNEXPECTED_EOF;
+			bits_pending = bits;
 		}
-		partial_byte = readByte();
-		bits_pending = 8;
 	}
-
+	uint32_t returnval = (uint32_t)(bitbuffer>>(64-bits));
+	bitbuffer <<= bits;
+	bits_pending -= bits;
 	return returnval;
 }
 
@@ -6,6 +6,7 @@
 #include <cstring>
 #include <cmath>
 #include <cassert>
+#include <bitset>
 
 #include "swftypedefs.h"
 
@@ -31,6 +32,9 @@ namespace SWF
 		SWF_COMPRESSION_VERSION_MISMATCH,
 		SWF_FILE_PROTECTED,
 		SWF_FILE_ENCRYPTED,
+		SWF_UNEXPECTED_EOF,
+		SWF_FILE_OPEN_ERROR,
+		SWF_FILE_WRITE_ERROR,
 
 		ZLIB_NOT_COMPILED,
 		ZLIB_ERRNO,
@@ -116,17 +120,68 @@ namespace SWF
 		EnableTelemetry					= 93
 	};
 
+	class TagFilter
+	{
+		std::bitset<TagType::EnableTelemetry+1> mask;
+
+	public:
+		TagFilter(bool all=true) { if(all) mask.set(); }
+		TagFilter &add(TagType t) { mask.set(t); return *this; }
+		TagFilter &remove(TagType t) { mask.reset(t); return *this; }
+		bool test(uint16_t tag) const { return tag<mask.size() && mask[tag]; }
+
+		static TagFilter all() { return TagFilter(true); }
+		static TagFilter header_only()
+		{
+			return TagFilter(false).add(SetBackgroundColor).add(Protect);
+		}
+		static TagFilter shapes_only()
+		{
+			return TagFilter(false).add(DefineShape).add(DefineShape2).add(DefineShape3).add(DefineShape4).add(Protect);
+		}
+		static TagFilter timeline_only()
+		{
+			return TagFilter(false).add(ShowFrame).add(PlaceObject).add(PlaceObject2).add(PlaceObject3)
+				.add(RemoveObject).add(RemoveObject2).add(FrameLabel).add(DefineSceneAndFrameLabelData).add(Protect);
+		}
+	};
+
+	class InputSource;
+
+	struct ParseOptions
+	{
+		bool streaming = false;			// Decompress CWS/ZWS bodies in chunks while tags are being parsed
+		uint32_t stream_window = 65536;	// Bytes of decompressed data held at once in streaming mode
+		bool pipelined = false;			// Streaming, with decompression running on its own thread
+		uint32_t pipeline_buffer = 1<<20;	// Ring buffer size between the decompressor and parser threads
+		TagFilter tags;					// Tags to decode; everything else is skipped by its header length
+		uint16_t frame_limit = 0;		// Stop after this many ShowFrame tags, or 0 to read the whole file
+		bool lazy = false;				// Only index tag headers; characters are decoded by Parser::get_character
+		unsigned shape_threads = 0;		// Decode shape tags on this many threads after the tag loop; 0 decodes them in order
+		uint16_t keyframe_interval = 32;	// Frames between full display list snapshots in the timeline
+	};
+
 	class Stream
 	{
 		uint8_t *data;
 		uint32_t datalength;
+		uint32_t dataoffset;
+		uint32_t streamlength;
 		uint8_t swfversion;
 		uint32_t pos;
-		uint8_t bits_pending : 4;
-		uint8_t partial_byte;
-		const uint8_t bitmasks[9] = {0x00, 0x01, 0x03, 0x07, 0x0F, 0x1F, 0x3F, 0x7F, 0xFF};
+		uint64_t bitbuffer;		// Unread bits, most significant first
+		uint8_t bits_pending;	// Whole bytes of bitbuffer are given back to pos when realigning
+
+		InputSource *source;
+		uint32_t windowsize;
+		bool ownsdata;			// Set for decompressed buffers, which are freed with the stream
+		Error error;
 
 		Dictionary *dict;
+		std::vector<Vertex> vertexscratch;
+
+		bool refill();
+		void inline fill_bits();
 
 		FillStyle inline readFILLSTYLE(uint16_t);
 		uint16_t inline readFILLSTYLEARRAY(uint16_t, uint16_t);
@@ -138,18 +193,27 @@ namespace SWF
 		GradRecord inline readGRADRECORD(uint16_t);
 		Vertex inline readSHAPERECORDedge(ShapeRecordType, uint8_t);
 		StyleChangeRecord inline readSHAPERECORDstylechange(uint16_t, uint16_t, uint8_t);
+		void inline end_shape(Character&, Shape&);
 
 	public:
-		Stream(uint8_t*,uint32_t);
-		void inline seek(uint32_t s){pos=s;}
-		uint32_t inline get_pos(){return pos;};
-		void inline rewind(){pos=0;}
-		void inline reset_bits_pending(){bits_pending=0;}
+		Stream(uint8_t*,uint32_t,bool owned=false);
+		Stream(InputSource*,uint32_t,uint32_t);
+		~Stream();
+		void close_source();
+		void seek(uint32_t);
+		uint32_t inline get_pos(){return dataoffset+pos-(bits_pending>>3);};
+		uint32_t inline get_length(){return streamlength;}
+		void inline rewind(){seek(0);}
+		void inline reset_bits_pending(){pos-=(bits_pending>>3); bits_pending=0; bitbuffer=0;}
 
 		Dictionary *get_dict(){return dict;}
+		Error get_error(){return error;}
+		bool is_streaming(){return source!=NULL;}
+		Stream *duplicate();
 
 		RecordHeader inline readRECORDHEADER();
-		void inline readSHAPEWITHSTYLE(uint16_t, Rect, uint16_t);
+		void inline readDEFINESHAPE(uint16_t);
+		void inline readSHAPEWITHSTYLE(uint16_t, Rect, uint16_t, FillRule);
 		void inline readFILTERLIST();
 
 		Rect inline readRECT();
@@ -192,14 +256,30 @@ namespace SWF
 		Stream *swfstream;
 		Dictionary *dictionary;
 		Properties *movieprops;
+		ParseOptions options;
+		uint8_t *filedata;
+		size_t filelength;
+		TagIndex tagindex;
+		IdTable<size_t> characterindex;
 
-		Error tag_loop(Stream*);
+		Error tag_loop(Stream*, DisplayList, uint16_t, const TagFilter&);
+		Error index_tags(Stream*);
+		Error decode_shapes(Stream*, const TagIndex&);
+		Stream *open_stream(InputSource*, uint32_t);
+		void close_file();
+		void reset();
 
 	public:
-		Parser() { swfstream = NULL; dictionary = NULL; movieprops=NULL; }
-		~Parser() { if(dictionary) delete dictionary; }
+		Parser() { swfstream = NULL; dictionary = NULL; movieprops=NULL; filedata = NULL; filelength = 0; }
+		~Parser() { reset(); close_file(); }
 		Error parse_swf_data(uint8_t*, uint32_t, const char *password="");
+		Error parse_swf_file(const char*, const char *password="");
+		void set_options(ParseOptions o) { options = o; }
+		ParseOptions get_options() { return options; }
 		Dictionary *get_dict() { return dictionary; }
+		TagIndex *get_tag_index() { return &tagindex; }
+		Character *get_character(uint16_t);	// In lazy mode the parsed data must stay valid until characters are decoded
+		Error decode_frames(uint16_t count=0);	// Continues the timeline after a lazy or frame-limited parse; 0 decodes every remaining frame
 		Properties *get_properties() { return movieprops; }
 	};
 	
@@ -0,0 +1,129 @@
+#include "swfpaths.h"
+#include <algorithm>
+using namespace SWF;
+
+#define PATH_END	0xFFFFFFFFu
+
+static inline uint64_t point_key(Coord x, Coord y)
+{
+	return (uint64_t(uint32_t(coord_to_twips(x)))<<32) | uint32_t(coord_to_twips(y));
+}
+
+static inline bool is_straight(const Vertex &v)
+{
+	return coord_to_twips(v.anchor.x)==coord_to_twips(v.control.x) && coord_to_twips(v.anchor.y)==coord_to_twips(v.control.y);
+}
+
+void PathBuilder::build(const Character &character, FillPaths &out)
+{
+	out.clear();
+	segments.clear();
+	const VertexPool &pool = character.vertices;
+	for(uint32_t i=0; i<character.shapes.size(); i++) {
+		const Shape &shape = character.shapes[i];
+		if(shape.count<2 || (!shape.fill0 && !shape.fill1))
+			continue;
+		Vertex first = pool.get(shape.offset);
+		Vertex last = pool.get(shape.offset+shape.count-1);
+		uint64_t firstkey = point_key(first.anchor.x, first.anchor.y);
+		uint64_t lastkey = point_key(last.anchor.x, last.anchor.y);
+		if(shape.fill1)	// Fill on the right of the edge direction; keep it as is
+			segments.push_back({ shape.fill1, shape.layer, false, i, firstkey, lastkey });
+		if(shape.fill0)	// Fill on the left; trace the run backwards
+			segments.push_back({ shape.fill0, shape.layer, true, i, lastkey, firstkey });
+	}
+
+	uint32_t count = (uint32_t)segments.size();
+	order.resize(count);
+	for(uint32_t i=0; i<count; i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return segments[a].fill<segments[b].fill; });
+	next.assign(count, PATH_END);
+	used.assign(count, false);
+
+	uint32_t groupstart = 0;
+	while(groupstart<count) {
+		uint16_t fill = segments[order[groupstart]].fill;
+		uint32_t groupend = groupstart;
+		while(groupend<count && segments[order[groupend]].fill==fill)
+			groupend++;
+
+		// Chain segments by start point, earliest in file order first
+		heads.clear();
+		for(uint32_t i=groupend; i-->groupstart;) {
+			uint32_t s = order[i];
+			std::unordered_map<uint64_t,uint32_t>::iterator head = heads.find(segments[s].start);
+			if(head==heads.end()) {
+				heads[segments[s].start] = s;
+			} else {
+				next[s] = head->second;
+				head->second = s;
+			}
+		}
+
+		FillPath path;
+		path.fill = fill;
+		path.layer = segments[order[groupstart]].layer;
+		for(uint32_t i=groupstart; i<groupend; i++) {
+			uint32_t s = order[i];
+			if(used[s])
+				continue;
+			used[s] = true;
+			Contour contour;
+			contour.offset = (uint32_t)out.vertices.size();
+			append_segment(pool, character.shapes[segments[s].shape], segments[s].reversed, true, out.vertices);
+			uint64_t startkey = segments[s].start;
+			uint64_t endkey = segments[s].end;
+			while(endkey!=startkey) {
+				std::unordered_map<uint64_t,uint32_t>::iterator head = heads.find(endkey);
+				if(head==heads.end())
+					break;
+				uint32_t &candidate = head->second;
+				while(candidate!=PATH_END && used[candidate])	// Drop segments already taken as a contour's first run
+					candidate = next[candidate];
+				if(candidate==PATH_END)
+					break;
+				uint32_t joined = candidate;
+				candidate = next[joined];
+				used[joined] = true;
+				append_segment(pool, character.shapes[segments[joined].shape], segments[joined].reversed, false, out.vertices);
+				endkey = segments[joined].end;
+			}
+			contour.closed = (endkey==startkey);
+			contour.count = (uint32_t)out.vertices.size()-contour.offset;
+			path.contours.push_back(contour);
+		}
+		out.fills.push_back(std::move(path));
+		groupstart = groupend;
+	}
+}
+
+void PathBuilder::append_segment(const VertexPool &pool, const Shape &shape, bool reversed, bool withstart, std::vector<Vertex> &vertices)
+{
+	uint32_t first = shape.offset;
+	uint32_t last = shape.offset+shape.count-1;
+	if(!reversed) {
+		if(withstart) {
+			Vertex start = pool.get(first);
+			start.control = start.anchor;
+			vertices.push_back(start);
+		}
+		for(uint32_t i=first+1; i<=last; i++)
+			vertices.push_back(pool.get(i));
+	} else {
+		Vertex edge = pool.get(last);
+		if(withstart) {
+			Vertex start;
+			start.anchor = start.control = edge.anchor;
+			vertices.push_back(start);
+		}
+		for(uint32_t i=last; i>first; i--) {
+			Vertex previous = pool.get(i-1);
+			Vertex v;
+			v.anchor = previous.anchor;
+			v.control = is_straight(edge) ? previous.anchor : edge.control;	// Straight edges keep their control on the anchor
+			vertices.push_back(v);
+			edge = previous;
+		}
+	}
+}
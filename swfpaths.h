@@ -0,0 +1,63 @@
+#ifndef LIBSHOCKWAVE_SWF_PATHS_H
+#define LIBSHOCKWAVE_SWF_PATHS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+#include "swftypedefs.h"
+
+namespace SWF
+{
+
+	// A contour is a range in FillPaths::vertices laid out like a Shape run: the first vertex
+	// is the start point and each following vertex is an edge ending at its anchor.
+	struct Contour
+	{
+		uint32_t offset = 0;
+		uint32_t count = 0;
+		bool closed = false;
+	};
+	struct FillPath
+	{
+		uint16_t fill = 0;	// 1-based index into the character's FillStyleArray
+		uint8_t layer = 0;
+		std::vector<Contour> contours;
+	};
+	struct FillPaths
+	{
+		std::vector<Vertex> vertices;
+		std::vector<FillPath> fills;	// Sorted by fill index, which also puts them in layer order
+		void clear() { vertices.clear(); fills.clear(); }
+	};
+
+	// Joins a character's edge runs into closed contours for each fill style. Runs are traced
+	// with their fill on the right, so fill0 runs are reversed, and endpoints are matched through
+	// a hash keyed on integer twips. Keeps its scratch space between calls; use one per thread.
+	class PathBuilder
+	{
+		struct Segment
+		{
+			uint16_t fill;
+			uint8_t layer;
+			bool reversed;
+			uint32_t shape;
+			uint64_t start;
+			uint64_t end;
+		};
+		std::vector<Segment> segments;
+		std::vector<uint32_t> order;
+		std::vector<uint32_t> next;
+		std::vector<bool> used;
+		std::unordered_map<uint64_t,uint32_t> heads;
+
+		void append_segment(const VertexPool&, const Shape&, bool, bool, std::vector<Vertex>&);
+
+	public:
+		void build(const Character&, FillPaths&);
+	};
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_PATHS_H
@@ -0,0 +1,438 @@
+#include "swfrenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef LIBSHOCKWAVE_SSE2
+	#include <emmintrin.h>
+#endif
+using namespace SWF;
+
+static inline void transform_colour(RGBA colour, const CXForm &cx, float *out)
+{
+	float r = std::min(std::max(colour.r*cx.RedMultTerm + cx.RedAddTerm, 0.0f), 255.0f);
+	float g = std::min(std::max(colour.g*cx.GreenMultTerm + cx.GreenAddTerm, 0.0f), 255.0f);
+	float b = std::min(std::max(colour.b*cx.BlueMultTerm + cx.BlueAddTerm, 0.0f), 255.0f);
+	float a = std::min(std::max(colour.a*cx.AlphaMultTerm + cx.AlphaAddTerm, 0.0f), 255.0f);
+	out[0] = r*a/255.0f;
+	out[1] = g*a/255.0f;
+	out[2] = b*a/255.0f;
+	out[3] = a;
+}
+
+// Adds a line's signed area to the accumulation buffer, whose running sum along each row gives
+// coverage. x is clamped to [0,width]; clamping on the left loses nothing because the sum starts there.
+static void draw_line(float *acc, uint32_t stride, uint32_t height, float width, float x0, float y0, float x1, float y1)
+{
+	if(y0==y1)
+		return;
+	float dir = 1.0f;
+	if(y0>y1) {
+		dir = -1.0f;
+		std::swap(x0, x1);
+		std::swap(y0, y1);
+	}
+	float dxdy = (x1-x0)/(y1-y0);
+	float x = x0;
+	if(y0<0.0f)
+		x -= y0*dxdy;
+	uint32_t ystart = (y0>0.0f) ? (uint32_t)y0 : 0;
+	uint32_t yend = std::min(height, (uint32_t)ceilf(std::max(y1, 0.0f)));
+	for(uint32_t y=ystart; y<yend; y++) {
+		float *row = acc+y*stride;
+		float dy = std::min(float(y+1), y1) - std::max(float(y), y0);
+		float xnext = x + dxdy*dy;
+		float d = dy*dir;
+		float left = std::min(std::max(std::min(x, xnext), 0.0f), width);
+		float right = std::min(std::max(std::max(x, xnext), 0.0f), width);
+		float leftfloor = floorf(left);
+		uint32_t lefti = (uint32_t)leftfloor;
+		float rightceil = ceilf(right);
+		uint32_t righti = (uint32_t)rightceil;
+		if(righti<=lefti+1) {
+			float xmf = 0.5f*(left+right) - leftfloor;
+			row[lefti] += d - d*xmf;
+			row[lefti+1] += d*xmf;
+		} else {
+			float s = 1.0f/(right-left);
+			float leftf = left-leftfloor;
+			float a0 = 0.5f*s*(1.0f-leftf)*(1.0f-leftf);
+			float rightf = right-rightceil+1.0f;
+			float am = 0.5f*s*rightf*rightf;
+			row[lefti] += d*a0;
+			if(righti==lefti+2) {
+				row[lefti+1] += d*(1.0f-a0-am);
+			} else {
+				float a1 = s*(1.5f-leftf);
+				row[lefti+1] += d*(a1-a0);
+				for(uint32_t xi=lefti+2; xi<righti-1; xi++)
+					row[xi] += d*s;
+				float a2 = a1 + (righti-lefti-3)*s;
+				row[righti-1] += d*(1.0f-a2-am);
+			}
+			row[righti] += d*am;
+		}
+		x = xnext;
+	}
+}
+
+// Blends a premultiplied colour over a run of RGBA8 pixels, scaled by each pixel's coverage
+static void blend_span(uint8_t *dst, const float *coverage, uint32_t count, const float *colour)
+{
+	float alpha = colour[3]/255.0f;
+	uint8_t solid[4] = { (uint8_t)(colour[0]+0.5f), (uint8_t)(colour[1]+0.5f), (uint8_t)(colour[2]+0.5f), (uint8_t)(colour[3]+0.5f) };
+	bool opaque = (colour[3]>=255.0f);
+#ifdef LIBSHOCKWAVE_SSE2
+	const __m128 src = _mm_loadu_ps(colour);
+	const __m128i zero = _mm_setzero_si128();
+#endif
+	for(uint32_t i=0; i<count; i++, dst+=4) {
+		float c = coverage[i];
+		if(c<(1.0f/512.0f))
+			continue;
+		if(c>=1.0f && opaque) {
+			memcpy(dst, solid, 4);
+			continue;
+		}
+#ifdef LIBSHOCKWAVE_SSE2
+		int32_t pixel;
+		memcpy(&pixel, dst, 4);
+		__m128 d = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero));
+		__m128 result = _mm_add_ps(_mm_mul_ps(src, _mm_set1_ps(c)), _mm_mul_ps(d, _mm_set1_ps(1.0f-alpha*c)));
+		__m128i packed = _mm_cvtps_epi32(result);
+		packed = _mm_packs_epi32(packed, packed);
+		pixel = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+		memcpy(dst, &pixel, 4);
+#else
+		float keep = 1.0f-alpha*c;
+		for(int channel=0; channel<4; channel++)
+			dst[channel] = (uint8_t)std::min(colour[channel]*c + dst[channel]*keep + 0.5f, 255.0f);
+#endif
+	}
+}
+
+// As blend_span, but with a premultiplied RGBA8 colour per pixel
+static void blend_texels(uint8_t *dst, const float *coverage, uint32_t count, const uint8_t *colours)
+{
+#ifdef LIBSHOCKWAVE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+#endif
+	for(uint32_t i=0; i<count; i++, dst+=4, colours+=4) {
+		float c = coverage[i];
+		if(c<(1.0f/512.0f) || !colours[3])
+			continue;
+		if(c>=1.0f && colours[3]==0xFF) {
+			memcpy(dst, colours, 4);
+			continue;
+		}
+		float keep = 1.0f-colours[3]*c/255.0f;
+#ifdef LIBSHOCKWAVE_SSE2
+		int32_t pixel, colour;
+		memcpy(&pixel, dst, 4);
+		memcpy(&colour, colours, 4);
+		__m128 d = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero));
+		__m128 src = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(colour), zero), zero));
+		__m128 result = _mm_add_ps(_mm_mul_ps(src, _mm_set1_ps(c)), _mm_mul_ps(d, _mm_set1_ps(keep)));
+		__m128i packed = _mm_cvtps_epi32(result);
+		packed = _mm_packs_epi32(packed, packed);
+		pixel = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+		memcpy(dst, &pixel, 4);
+#else
+		for(int channel=0; channel<4; channel++)
+			dst[channel] = (uint8_t)std::min(colours[channel]*c + dst[channel]*keep + 0.5f, 255.0f);
+#endif
+	}
+}
+
+static bool is_drawable(const FillStyleArray *styles, uint16_t index)
+{
+	if(!styles || !index || index>styles->size())
+		return false;
+	const FillStyle &style = (*styles)[index-1];
+	return (style.StyleType==FillStyle::Type::SOLID || is_gradient(style));
+}
+
+Renderer::Renderer(Dictionary *d, Properties *p, unsigned threads) : pool(threads), gradientcache(d)
+{
+	dict = d;
+	props = p;
+	tolerance = 0.25f;
+	viewscalex = viewscaley = 1.0f;
+	viewx = viewy = 0.0f;
+	workers.resize(pool.size());
+}
+
+Error Renderer::render_frame(size_t frame, uint16_t width, uint16_t height, uint8_t *out)
+{
+	if(!dict || !props || !out)
+		return Error::SWF_NULL_DATA;
+	if(frame>=dict->Frames.size())
+		return Error::SWF_DATA_INVALID;
+	return render(dict->Frames.get_frame(frame), width, height, out);
+}
+
+Error Renderer::render(const DisplayList &displaylist, uint16_t width, uint16_t height, uint8_t *out)
+{
+	if(!dict || !props || !out || !width || !height)
+		return Error::SWF_NULL_DATA;
+	float stagewidth = coord_to_float(props->dimensions.xmax-props->dimensions.xmin);
+	float stageheight = coord_to_float(props->dimensions.ymax-props->dimensions.ymin);
+	viewscalex = (stagewidth>0.0f) ? width/stagewidth : 1.0f;
+	viewscaley = (stageheight>0.0f) ? height/stageheight : 1.0f;
+	viewx = -coord_to_float(props->dimensions.xmin)*viewscalex;
+	viewy = -coord_to_float(props->dimensions.ymin)*viewscaley;
+
+	std::vector<const DisplayChar*> items;
+	for(DisplayList::const_iterator it=displaylist.begin(); it!=displaylist.end(); ++it)
+		items.push_back(&it->second);
+	placements.resize(items.size());
+	pool.parallel_for(items.size(), [&](size_t i, unsigned worker) {
+		build_placement(*items[i], workers[worker], placements[i]);
+	});
+	paints.clear();
+	lines.clear();
+	gradients.clear();
+	for(size_t i=0; i<items.size(); i++) {
+		for(Paint paint : placements[i].paints) {
+			paint.firstline += (uint32_t)lines.size();
+			if(paint.gradient>=0)
+				paint.gradient += (int32_t)gradients.size();
+			paints.push_back(paint);
+		}
+		lines.insert(lines.end(), placements[i].lines.begin(), placements[i].lines.end());
+		gradients.insert(gradients.end(), placements[i].gradients.begin(), placements[i].gradients.end());
+	}
+
+	RGBA background = props->bgcolour;
+	uint32_t bands = (height+RENDERER_BAND_HEIGHT-1)/RENDERER_BAND_HEIGHT;
+	pool.parallel_for(bands, [&](size_t band, unsigned worker) {
+		uint32_t top = (uint32_t)band*RENDERER_BAND_HEIGHT;
+		render_band(top, std::min<uint32_t>(top+RENDERER_BAND_HEIGHT, height), width, out, background, workers[worker]);
+	});
+	return Error::OK;
+}
+
+void Renderer::build_placement(const DisplayChar &placed, Worker &worker, Placement &placement)
+{
+	placement.paints.clear();
+	placement.lines.clear();
+	placement.gradients.clear();
+	CharacterDict::iterator character = dict->CharacterList.find(placed.id);
+	if(character==dict->CharacterList.end())
+		return;
+	FillStyleMap::iterator fills = dict->FillStyles.find(placed.id);
+	LineStyleMap::iterator strokes = dict->LineStyles.find(placed.id);
+	const FillStyleArray *fillstyles = (fills!=dict->FillStyles.end()) ? &fills->second : NULL;
+	const LineStyleArray *linestyles = (strokes!=dict->LineStyles.end()) ? &strokes->second : NULL;
+
+	// Character space to output pixels
+	const Matrix &m = placed.transform;
+	float a = viewscalex*m.ScaleX, c = viewscalex*m.RotateSkew1, tx = viewscalex*coord_to_float(m.TranslateX)+viewx;
+	float b = viewscaley*m.RotateSkew0, d = viewscaley*m.ScaleY, ty = viewscaley*coord_to_float(m.TranslateY)+viewy;
+	Matrix linear;
+	linear.ScaleX = a;
+	linear.RotateSkew0 = b;
+	linear.RotateSkew1 = c;
+	linear.ScaleY = d;
+	const float transform[6] = { a, b, c, d, tx, ty };
+
+	// Fills: every run adds its lines to the paint on its right (fill1) and, reversed, on its left (fill0)
+	worker.tagged.clear();
+	const VertexPool &pool = character->second.vertices;
+	for(const Shape &shape : character->second.shapes) {
+		if(shape.count<2 || !fillstyles)
+			continue;
+		bool right = is_drawable(fillstyles, shape.fill1);
+		bool left = is_drawable(fillstyles, shape.fill0);
+		if(!right && !left)
+			continue;
+		worker.vertices.resize(shape.count);
+		for(uint32_t i=0; i<shape.count; i++)
+			worker.vertices[i] = pool.get(shape.offset+i);
+		worker.points.clear();
+		worker.flattener.flatten(worker.vertices.data(), shape.count, linear, tolerance, worker.points);
+		for(size_t i=0; i<worker.points.size(); i+=2) {
+			float x = worker.points[i], y = worker.points[i+1];
+			worker.points[i] = a*x + c*y + tx;
+			worker.points[i+1] = b*x + d*y + ty;
+		}
+		for(size_t i=2; i<worker.points.size(); i+=2) {
+			Line line = { worker.points[i-2], worker.points[i-1], worker.points[i], worker.points[i+1] };
+			if(right)
+				worker.tagged.push_back({ shape.fill1, shape.layer, line });
+			if(left)
+				worker.tagged.push_back({ shape.fill0, shape.layer, { line.x1, line.y1, line.x0, line.y0 } });
+		}
+	}
+	std::sort(worker.tagged.begin(), worker.tagged.end(), [](const TaggedLine &l, const TaggedLine &r) {
+		return (l.style!=r.style) ? (l.style<r.style) : (std::min(l.line.y0, l.line.y1)<std::min(r.line.y0, r.line.y1));
+	});
+	for(size_t start=0, end=0; start<worker.tagged.size(); start=end) {
+		while(end<worker.tagged.size() && worker.tagged[end].style==worker.tagged[start].style)
+			end++;
+		uint16_t style = worker.tagged[start].style;
+		Paint paint;
+		paint.evenodd = (character->second.fillrule==FillRule::EVEN_ODD);
+		if(set_style((*fillstyles)[style-1], gradientcache.get_fill(placed.id, style), placed.colourtransform, transform, paint, placement))
+			add_paint(&worker.tagged[start], end-start, paint, false, placement);
+	}
+
+	// Strokes: expand to triangles, then outline each one with the same winding so overlaps merge
+	if(linestyles && !linestyles->empty()) {
+		worker.strokemesh.clear();
+		worker.stroker.set_tolerance(tolerance);
+		worker.stroker.stroke(character->second, *linestyles, worker.strokemesh, linear);
+		const std::vector<float> &v = worker.strokemesh.vertices;
+		for(const MeshBatch &batch : worker.strokemesh.batches) {
+			const LineStyle &style = (*linestyles)[batch.stroke-1];
+			Paint paint;
+			paint.evenodd = false;	// Overlapping stroke triangles must merge, not cancel
+			if(!style.HasFillFlag) {
+				transform_colour(style.Color, placed.colourtransform, paint.colour);
+				paint.gradient = -1;
+			} else if(!set_style(style.FillType, gradientcache.get_line(placed.id, batch.stroke), placed.colourtransform, transform, paint, placement)) {
+				continue;
+			}
+			worker.tagged.clear();
+			for(uint32_t i=batch.offset; i<batch.offset+batch.count; i+=3) {
+				float corner[6];
+				for(int k=0; k<3; k++) {
+					uint32_t index = worker.strokemesh.indices[i+k];
+					float x = v[index*2], y = v[index*2+1];
+					corner[k*2] = a*x + c*y + tx;
+					corner[k*2+1] = b*x + d*y + ty;
+				}
+				if((corner[2]-corner[0])*(corner[5]-corner[1]) - (corner[4]-corner[0])*(corner[3]-corner[1]) < 0.0f) {
+					std::swap(corner[2], corner[4]);
+					std::swap(corner[3], corner[5]);
+				}
+				for(int k=0; k<3; k++) {
+					int n = (k+1)%3;
+					worker.tagged.push_back({ batch.stroke, batch.layer, { corner[k*2], corner[k*2+1], corner[n*2], corner[n*2+1] } });
+				}
+			}
+			std::sort(worker.tagged.begin(), worker.tagged.end(), [](const TaggedLine &l, const TaggedLine &r) {
+				return std::min(l.line.y0, l.line.y1)<std::min(r.line.y0, r.line.y1);
+			});
+			add_paint(worker.tagged.data(), worker.tagged.size(), paint, true, placement);
+		}
+	}
+
+	// Draw by layer, with a layer's fills under its strokes
+	std::stable_sort(placement.paints.begin(), placement.paints.end(), [](const Paint &l, const Paint &r) {
+		return (l.layer!=r.layer) ? (l.layer<r.layer) : (!l.stroke && r.stroke);
+	});
+}
+
+// Sets a paint's colour from a fill style, or for gradients adds a span filler for it to the placement.
+// Returns false if the style cannot be drawn.
+bool Renderer::set_style(const FillStyle &style, const GradientRamp *ramp, const CXForm &cx, const float *transform, Paint &paint, Placement &placement)
+{
+	paint.gradient = -1;
+	if(style.StyleType==FillStyle::Type::SOLID) {
+		transform_colour(style.Color, cx, paint.colour);
+		return true;
+	}
+	if(!ramp)
+		return false;
+	GradientSpan span;
+	bool valid;
+	if(cx.IsModified()) {
+		GradientRamp transformed;	// Only untransformed ramps are shared; the bake transforms before premultiplying
+		bake_gradient_ramp(style.Gradient, transformed, &cx);
+		valid = span.set(style, transformed, transform[0], transform[1], transform[2], transform[3], transform[4], transform[5]);
+	} else {
+		valid = span.set(style, *ramp, transform[0], transform[1], transform[2], transform[3], transform[4], transform[5]);
+	}
+	if(!valid)
+		return false;
+	paint.colour[0] = paint.colour[1] = paint.colour[2] = paint.colour[3] = 255.0f;
+	paint.gradient = (int32_t)placement.gradients.size();
+	placement.gradients.push_back(span);
+	return true;
+}
+
+void Renderer::add_paint(const TaggedLine *tagged, size_t count, const Paint &style, bool stroke, Placement &placement)
+{
+	if(!count || style.colour[3]<=0.0f)
+		return;
+	Paint paint;
+	memcpy(paint.colour, style.colour, sizeof(paint.colour));
+	paint.gradient = style.gradient;
+	paint.evenodd = style.evenodd;
+	paint.firstline = (uint32_t)placement.lines.size();
+	paint.linecount = (uint32_t)count;
+	paint.layer = tagged[0].layer;
+	paint.stroke = stroke;
+	paint.xmin = paint.ymin = INFINITY;
+	paint.xmax = paint.ymax = -INFINITY;
+	for(size_t i=0; i<count; i++) {
+		const Line &line = tagged[i].line;
+		paint.xmin = std::min(paint.xmin, std::min(line.x0, line.x1));
+		paint.xmax = std::max(paint.xmax, std::max(line.x0, line.x1));
+		paint.ymin = std::min(paint.ymin, std::min(line.y0, line.y1));
+		paint.ymax = std::max(paint.ymax, std::max(line.y0, line.y1));
+		placement.lines.push_back(line);
+	}
+	placement.paints.push_back(paint);
+}
+
+void Renderer::render_band(uint32_t top, uint32_t bottom, uint16_t width, uint8_t *out, RGBA background, Worker &worker)
+{
+	uint32_t height = bottom-top;
+	uint32_t stride = width+2;	// Room for lines touching the right edge
+	if(worker.accumulation.size()<stride*height)
+		worker.accumulation.assign(stride*height, 0.0f);	// Kept zeroed between paints
+	worker.coverage.resize(stride);
+	worker.texels.resize(width*4);
+	float *acc = worker.accumulation.data();
+	float *coverage = worker.coverage.data();
+
+	uint8_t bg[4] = { background.r, background.g, background.b, 0xFF };
+	for(uint32_t y=top; y<bottom; y++) {
+		uint8_t *row = out+(size_t)y*width*4;
+		for(uint32_t x=0; x<width; x++)
+			memcpy(row+x*4, bg, 4);
+	}
+
+	for(const Paint &paint : paints) {
+		if(paint.ymax<=top || paint.ymin>=bottom || paint.xmax<=0.0f || paint.xmin>=width)
+			continue;
+		const Line *line = &lines[paint.firstline];
+		for(uint32_t i=0; i<paint.linecount; i++, line++) {
+			if(std::min(line->y0, line->y1)>=bottom)
+				break;	// Sorted by top, so the rest are below the band
+			if(std::max(line->y0, line->y1)<=top)
+				continue;
+			draw_line(acc, stride, height, width, line->x0, line->y0-top, line->x1, line->y1-top);
+		}
+
+		uint32_t left = (uint32_t)std::max(floorf(paint.xmin), 0.0f);
+		uint32_t right = (uint32_t)std::min(ceilf(paint.xmax)+2.0f, (float)stride);
+		uint32_t spanend = std::min<uint32_t>(right, width);
+		uint32_t rowstart = (uint32_t)std::max(floorf(paint.ymin-top), 0.0f);
+		uint32_t rowend = (uint32_t)std::min(ceilf(paint.ymax-top), (float)height);
+		for(uint32_t y=rowstart; y<rowend; y++) {
+			float *row = acc+y*stride;
+			float sum = 0.0f;
+			if(paint.evenodd) {	// Fold the winding so that every second crossing leaves the fill again
+				for(uint32_t x=left; x<spanend; x++) {
+					sum += row[x];
+					float folded = fabsf(sum) - 2.0f*floorf(fabsf(sum)*0.5f);
+					coverage[x] = (folded>1.0f) ? 2.0f-folded : folded;
+				}
+			} else {
+				for(uint32_t x=left; x<spanend; x++) {
+					sum += row[x];
+					coverage[x] = std::min(fabsf(sum), 1.0f);
+				}
+			}
+			if(spanend>left && paint.gradient>=0) {
+				gradients[paint.gradient].fill(left, top+y, spanend-left, worker.texels.data());
+				blend_texels(out+((size_t)(top+y)*width+left)*4, coverage+left, spanend-left, worker.texels.data());
+			} else if(spanend>left) {
+				blend_span(out+((size_t)(top+y)*width+left)*4, coverage+left, spanend-left, paint.colour);
+			}
+			memset(row+left, 0, (right-left)*sizeof(float));
+		}
+	}
+}
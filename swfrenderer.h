@@ -0,0 +1,98 @@
+#ifndef LIBSHOCKWAVE_SWF_RENDERER_H
+#define LIBSHOCKWAVE_SWF_RENDERER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "swfparser.h"
+#include "swfflatten.h"
+#include "swfstroker.h"
+#include "swfgradient.h"
+#include "swfthreadpool.h"
+
+#define RENDERER_BAND_HEIGHT	16
+
+namespace SWF
+{
+
+	// Software renderer producing RGBA8 images of a movie's frames. Every placed character's fills
+	// and strokes become paints: lists of device space lines sorted by their top, with a colour
+	// that already has the placement's CXForm applied. Paints are built in parallel, then the
+	// image is cut into bands of rows that workers render independently, accumulating analytic
+	// area coverage per pixel (as in font-rs) and blending each paint's spans over the band.
+	// Fills follow the character's fill rule. Solid and gradient fills are drawn; bitmap fills are skipped.
+	class Renderer
+	{
+		struct Line
+		{
+			float x0, y0, x1, y1;
+		};
+		struct Paint
+		{
+			float colour[4];	// Premultiplied, 0-255
+			int32_t gradient;	// Index into the gradient spans, or -1 for a solid colour
+			bool evenodd;		// The character's fill rule; strokes are always non-zero
+			float xmin, ymin, xmax, ymax;
+			uint32_t firstline;
+			uint32_t linecount;
+			uint8_t layer;
+			bool stroke;
+		};
+		struct TaggedLine
+		{
+			uint16_t style;
+			uint8_t layer;
+			Line line;
+		};
+		struct Placement
+		{
+			std::vector<Paint> paints;
+			std::vector<Line> lines;
+			std::vector<GradientSpan> gradients;
+		};
+		struct Worker
+		{
+			Flattener flattener;
+			Stroker stroker;
+			Mesh strokemesh;
+			std::vector<Vertex> vertices;
+			std::vector<float> points;
+			std::vector<TaggedLine> tagged;
+			std::vector<float> accumulation;
+			std::vector<float> coverage;
+			std::vector<uint8_t> texels;
+		};
+
+		Dictionary *dict;
+		Properties *props;
+		ThreadPool pool;
+		std::vector<Worker> workers;
+		std::vector<Placement> placements;
+		std::vector<Paint> paints;
+		std::vector<Line> lines;
+		std::vector<GradientSpan> gradients;
+		GradientCache gradientcache;
+		float tolerance;
+		float viewscalex, viewscaley;	// Stage to output pixels
+		float viewx, viewy;
+
+		void build_placement(const DisplayChar&, Worker&, Placement&);
+		bool set_style(const FillStyle&, const GradientRamp*, const CXForm&, const float*, Paint&, Placement&);
+		void add_paint(const TaggedLine*, size_t, const Paint&, bool, Placement&);
+		void render_band(uint32_t, uint32_t, uint16_t, uint8_t*, RGBA, Worker&);
+
+	public:
+		Renderer(Dictionary*, Properties*, unsigned threads=0);	// 0 threads uses every core
+		void set_tolerance(float t) { tolerance = t; }
+		float get_tolerance() { return tolerance; }
+
+		// Draws a frame over the background colour, scaling the movie's stage to fill width by height.
+		// out must hold width*height*4 bytes; the result is opaque, so it is both straight and premultiplied.
+		Error render_frame(size_t, uint16_t, uint16_t, uint8_t*);
+		Error render(const DisplayList&, uint16_t, uint16_t, uint8_t*);
+	};
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_RENDERER_H
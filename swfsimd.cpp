@@ -0,0 +1,34 @@
+#include "swfsimd.h"
+#if defined(LIBSHOCKWAVE_AVX2) && defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h>
+	#include <immintrin.h>
+#endif
+using namespace SWF;
+
+bool SWF::cpu_has_avx2()
+{
+#if !defined(LIBSHOCKWAVE_AVX2)
+	return false;
+#elif defined(_MSC_VER) && !defined(__clang__)
+	static const bool avx2 = []() {
+		int info[4];
+		__cpuid(info, 0);
+		if(info[0]<7)
+			return false;
+		__cpuid(info, 1);
+		bool osxsave = (info[2]&(1<<27))!=0;
+		bool avx = (info[2]&(1<<28))!=0;
+		if(!osxsave || !avx || (_xgetbv(0)&0x6)!=0x6)	// The OS must save the YMM registers
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1]&(1<<5))!=0;
+	}();
+	return avx2;
+#else
+	static const bool avx2 = []() {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2")!=0;
+	}();
+	return avx2;
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef LIBSHOCKWAVE_SWF_SIMD_H
+#define LIBSHOCKWAVE_SWF_SIMD_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+	#define LIBSHOCKWAVE_SSE2
+#endif
+
+// AVX2 kernels are built alongside the baseline ones on x86 and picked at run time with cpu_has_avx2()
+#if defined(LIBSHOCKWAVE_SSE2) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+	#define LIBSHOCKWAVE_AVX2
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#define LIBSHOCKWAVE_TARGET_AVX2
+	#else
+		#define LIBSHOCKWAVE_TARGET_AVX2	__attribute__((target("avx2")))
+	#endif
+#endif
+
+namespace SWF
+{
+
+	bool cpu_has_avx2();
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_SIMD_H
@@ -0,0 +1,193 @@
+#include "swfsource.h"
+using namespace SWF;
+
+#define PIPELINE_CHUNK 16384
+
+PipelineSource::PipelineSource(InputSource *src, size_t len)
+{
+	source = src;
+	capacity = PIPELINE_CHUNK;
+	while(capacity<len)	capacity <<= 1;	// Power of two, so positions wrap with a mask
+	ring = (uint8_t*)malloc(capacity);
+	head = tail = 0;
+	done = stop = false;
+	producerwaiting = consumerwaiting = false;
+	error = Error::OK;
+	worker = std::thread(&PipelineSource::produce, this);
+}
+
+PipelineSource::~PipelineSource()
+{
+	stop.store(true);
+	notify(producerwaiting);
+	worker.join();
+	delete source;
+	free(ring);
+}
+
+// The positions and flags are sequentially consistent: either the sleeper's last check sees the
+// update, or the update sees the sleeper's flag and wakes it through the mutex
+void PipelineSource::notify(std::atomic<bool> &waiting)
+{
+	if(!waiting.load())
+		return;
+	{ std::lock_guard<std::mutex> lock(waitmutex); }
+	waitcv.notify_all();
+}
+
+void PipelineSource::produce()
+{
+	size_t written = 0;
+	while(!stop.load(std::memory_order_acquire)) {
+		size_t space = capacity-(written-tail.load(std::memory_order_acquire));
+		if(space==0) {	// Back-pressure: wait for the parser to catch up
+			std::unique_lock<std::mutex> lock(waitmutex);
+			producerwaiting.store(true);
+			waitcv.wait(lock, [&]{ return stop.load() || written-tail.load()<capacity; });
+			producerwaiting.store(false);
+			continue;
+		}
+		size_t offset = written&(capacity-1);
+		size_t chunk = capacity-offset;
+		if(chunk>space)				chunk = space;
+		if(chunk>PIPELINE_CHUNK)	chunk = PIPELINE_CHUNK;
+		size_t produced = source->read(&ring[offset], chunk);
+		if(produced==0)
+			break;
+		written += produced;
+		head.store(written);
+		notify(consumerwaiting);
+	}
+	error = source->get_error();
+	done.store(true);
+	notify(consumerwaiting);
+}
+
+size_t PipelineSource::read(uint8_t *buffer, size_t len)
+{
+	size_t consumed = tail.load(std::memory_order_relaxed);
+	size_t available = head.load(std::memory_order_acquire)-consumed;
+	if(available==0) {
+		std::unique_lock<std::mutex> lock(waitmutex);
+		consumerwaiting.store(true);
+		waitcv.wait(lock, [&]{ return done.load() || head.load()!=consumed; });
+		consumerwaiting.store(false);
+		available = head.load(std::memory_order_acquire)-consumed;
+		if(available==0)
+			return 0;
+	}
+	if(len>available)
+		len = available;
+	size_t offset = consumed&(capacity-1);
+	size_t first = (len<capacity-offset) ? len : capacity-offset;
+	memcpy(buffer, &ring[offset], first);
+	memcpy(&buffer[first], ring, len-first);
+	tail.store(consumed+len);
+	notify(producerwaiting);
+	return len;
+}
+
+Error PipelineSource::get_error()
+{
+	// Decompression errors are only reported once everything decoded before them has been read
+	if(!done.load(std::memory_order_acquire) || head.load(std::memory_order_acquire)!=tail.load(std::memory_order_relaxed))
+		return Error::OK;
+	return error;
+}
+
+#ifndef LIBSHOCKWAVE_DISABLE_ZLIB
+static Error zlib_error(int zliberror)
+{
+	switch(zliberror) {
+		case Z_ERRNO:			return Error::ZLIB_ERRNO;
+		case Z_STREAM_ERROR:	return Error::ZLIB_STREAM_ERROR;
+		case Z_DATA_ERROR:		return Error::ZLIB_DATA_ERROR;
+		case Z_MEM_ERROR:		return Error::ZLIB_MEMORY_ERROR;
+		case Z_BUF_ERROR:		return Error::ZLIB_BUFFER_ERROR;
+		case Z_VERSION_ERROR:	return Error::ZLIB_VERSION_ERROR;
+	}
+	return Error::OK;
+}
+
+ZlibSource::ZlibSource(const uint8_t *d, size_t len)
+{
+	memset(&zstream, 0, sizeof(z_stream));
+	zstream.next_in = (Bytef*)d;
+	zstream.avail_in = (uInt)len;
+	finished = false;
+	error = zlib_error(inflateInit(&zstream));
+}
+
+ZlibSource::~ZlibSource()
+{
+	inflateEnd(&zstream);
+}
+
+size_t ZlibSource::read(uint8_t *buffer, size_t len)
+{
+	if(finished || error!=Error::OK)
+		return 0;
+	zstream.next_out = buffer;
+	zstream.avail_out = (uInt)len;
+	int zliberror = inflate(&zstream, Z_SYNC_FLUSH);
+	if(zliberror==Z_STREAM_END)
+		finished = true;
+	else if(zliberror!=Z_OK)
+		error = zlib_error(zliberror);
+	return len-zstream.avail_out;
+}
+#endif
+
+#ifndef LIBSHOCKWAVE_DISABLE_LZMA
+#include "lzma/Alloc.h"
+
+static Error lzma_error(SRes lzmaerror)
+{
+	switch(lzmaerror) {
+		case SZ_ERROR_DATA:			return Error::LZMA_DATA_ERROR;
+		case SZ_ERROR_MEM:			return Error::LZMA_MEM_ALLOC_ERROR;
+		case SZ_ERROR_UNSUPPORTED:	return Error::LZMA_INVALID_PROPS;
+		case SZ_ERROR_INPUT_EOF:	return Error::LZMA_UNEXPECTED_EOF;
+	}
+	return Error::OK;
+}
+
+LzmaSource::LzmaSource(const uint8_t *props, const uint8_t *d, size_t len, size_t outlen)
+{
+	input = d;
+	inputlength = len;
+	outputremaining = outlen;
+	finished = false;
+	LzmaDec_Construct(&decoder);
+	error = lzma_error(LzmaDec_Allocate(&decoder, props, LZMA_PROPS_SIZE, &g_Alloc));
+	if(error==Error::OK)
+		LzmaDec_Init(&decoder);
+}
+
+LzmaSource::~LzmaSource()
+{
+	LzmaDec_Free(&decoder, &g_Alloc);
+}
+
+size_t LzmaSource::read(uint8_t *buffer, size_t len)
+{
+	if(finished || error!=Error::OK)
+		return 0;
+	if(len>outputremaining)
+		len = outputremaining;
+	SizeT decoded = len;
+	SizeT consumed = inputlength;
+	ELzmaStatus status;
+	SRes lzmaerror = LzmaDec_DecodeToBuf(&decoder, buffer, &decoded, input, &consumed, LZMA_FINISH_ANY, &status);
+	input += consumed;
+	inputlength -= consumed;
+	outputremaining -= decoded;
+	if(lzmaerror!=SZ_OK)
+		error = lzma_error(lzmaerror);
+	else if(status==LZMA_STATUS_FINISHED_WITH_MARK || outputremaining==0)
+		finished = true;
+	else if(decoded==0)
+		error = Error::LZMA_UNEXPECTED_EOF;
+	return decoded;
+}
+#endif
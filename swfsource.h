@@ -0,0 +1,91 @@
+#ifndef LIBSHOCKWAVE_SWF_SOURCE_H
+#define LIBSHOCKWAVE_SWF_SOURCE_H
+
+#include "swfparser.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#ifndef LIBSHOCKWAVE_DISABLE_ZLIB
+#include <zlib.h>
+#endif
+#ifndef LIBSHOCKWAVE_DISABLE_LZMA
+#define _LZMA_PROB32
+#include "lzma/LzmaDec.h"
+#endif
+
+namespace SWF
+{
+
+	class InputSource
+	{
+	public:
+		virtual ~InputSource() {}
+		virtual size_t read(uint8_t*, size_t) = 0;	// Returns 0 once the source is exhausted or has failed
+		virtual Error get_error() = 0;
+	};
+
+	class PipelineSource : public InputSource
+	{
+		InputSource *source;
+		uint8_t *ring;
+		size_t capacity;
+		std::atomic<size_t> head;	// Total bytes written by the decompressor thread
+		std::atomic<size_t> tail;	// Total bytes consumed by the parser thread
+		std::atomic<bool> done;
+		std::atomic<bool> stop;
+		std::atomic<bool> producerwaiting;	// Set while a side sleeps, so the other only locks and
+		std::atomic<bool> consumerwaiting;	// signals when someone is actually waiting
+		std::mutex waitmutex;		// Only taken to sleep when the ring is full or empty, and to wake a sleeper
+		std::condition_variable waitcv;
+		Error error;
+		std::thread worker;
+
+		void produce();
+		void notify(std::atomic<bool>&);
+
+	public:
+		PipelineSource(InputSource*, size_t);
+		~PipelineSource();
+		size_t read(uint8_t*, size_t);
+		Error get_error();
+	};
+
+	#ifndef LIBSHOCKWAVE_DISABLE_ZLIB
+	class ZlibSource : public InputSource
+	{
+		z_stream zstream;
+		bool finished;
+		Error error;
+
+	public:
+		ZlibSource(const uint8_t*, size_t);
+		~ZlibSource();
+		size_t read(uint8_t*, size_t);
+		Error get_error() { return error; }
+	};
+	#endif
+
+	#ifndef LIBSHOCKWAVE_DISABLE_LZMA
+	class LzmaSource : public InputSource
+	{
+		CLzmaDec decoder;
+		const uint8_t *input;
+		size_t inputlength;
+		size_t outputremaining;
+		bool finished;
+		Error error;
+
+	public:
+		LzmaSource(const uint8_t*, const uint8_t*, size_t, size_t);
+		~LzmaSource();
+		size_t read(uint8_t*, size_t);
+		Error get_error() { return error; }
+	};
+	#endif
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_SOURCE_H
@@ -0,0 +1,224 @@
+#include "swfstroker.h"
+#include <algorithm>
+#include <cmath>
+using namespace SWF;
+
+#define STROKE_PI	3.14159265358979f
+#define STROKE_MAX_ARC_STEPS	64
+
+Stroker::Stroker(float t)
+{
+	tolerance = t;
+	scalex = scaley = 1.0f;
+	halfx = halfy = 0.5f;
+	mesh = NULL;
+}
+
+void Stroker::stroke(const Character &character, const LineStyleArray &styles, Mesh &out, const Matrix &m)
+{
+	mesh = &out;
+	transform = m;
+	scalex = sqrtf(m.ScaleX*m.ScaleX + m.RotateSkew0*m.RotateSkew0);
+	scaley = sqrtf(m.RotateSkew1*m.RotateSkew1 + m.ScaleY*m.ScaleY);
+
+	// Collect stroked runs, chaining each onto the previous one when it carries on from its end
+	vertices.clear();
+	polylines.clear();
+	const VertexPool &pool = character.vertices;
+	for(const Shape &shape : character.shapes) {
+		if(!shape.stroke || shape.stroke>styles.size() || shape.count<2)
+			continue;
+		Vertex start = pool.get(shape.offset);
+		uint32_t first = shape.offset;
+		if(!polylines.empty() && polylines.back().stroke==shape.stroke &&
+			coord_to_twips(vertices.back().anchor.x)==coord_to_twips(start.anchor.x) &&
+			coord_to_twips(vertices.back().anchor.y)==coord_to_twips(start.anchor.y)) {
+			polylines.back().count += shape.count-1;
+			first++;
+		} else {
+			polylines.push_back({ shape.stroke, shape.layer, (uint32_t)vertices.size(), shape.count });
+		}
+		for(uint32_t i=first; i<shape.offset+shape.count; i++)
+			vertices.push_back(pool.get(i));
+	}
+	std::stable_sort(polylines.begin(), polylines.end(), [](const Polyline &a, const Polyline &b) { return a.stroke<b.stroke; });
+
+	MeshBatch batch;
+	for(const Polyline &polyline : polylines) {
+		if(polyline.stroke!=batch.stroke) {
+			batch.count = (uint32_t)mesh->indices.size()-batch.offset;
+			if(batch.stroke && batch.count)
+				mesh->batches.push_back(batch);
+			batch.stroke = polyline.stroke;
+			batch.layer = polyline.layer;
+			batch.offset = (uint32_t)mesh->indices.size();
+		}
+		points.clear();
+		flattener.flatten(&vertices[polyline.offset], polyline.count, transform, tolerance, points);
+		stroke_polyline(styles[polyline.stroke-1]);
+	}
+	batch.count = (uint32_t)mesh->indices.size()-batch.offset;
+	if(batch.stroke && batch.count)
+		mesh->batches.push_back(batch);
+	mesh = NULL;
+}
+
+void Stroker::set_width(const LineStyle &style, bool &hairline)
+{
+	float width = coord_to_float(style.Width);
+	halfx = halfy = width*0.5f;
+	if(style.NoHScaleFlag && scalex>0.0f)
+		halfx /= scalex;
+	if(style.NoVScaleFlag && scaley>0.0f)
+		halfy /= scaley;
+	hairline = (width<=0.0f || std::max(halfx*scalex, halfy*scaley)<=0.5f);
+	if(hairline) {
+		halfx = (scalex>0.0f) ? 0.5f/scalex : 0.5f;
+		halfy = (scaley>0.0f) ? 0.5f/scaley : 0.5f;
+	}
+}
+
+void Stroker::stroke_polyline(const LineStyle &style)
+{
+	// Drop repeated points so every segment has a direction
+	size_t kept = 2;
+	for(size_t i=2; i<points.size(); i+=2) {
+		if(points[i]==points[kept-2] && points[i+1]==points[kept-1])
+			continue;
+		points[kept] = points[i];
+		points[kept+1] = points[i+1];
+		kept += 2;
+	}
+	points.resize(kept);
+	size_t count = points.size()/2;
+	if(count<2)
+		return;
+	bool closed = (!style.NoClose && count>3 && points[0]==points[kept-2] && points[1]==points[kept-1]);
+	if(closed)
+		count--;	// The last point repeats the first
+	bool hairline;
+	set_width(style, hairline);
+
+	size_t segmentcount = closed ? count : count-1;
+	float firstx = 0.0f, firsty = 0.0f, lastx = 0.0f, lasty = 0.0f;
+	for(size_t s=0; s<segmentcount; s++) {
+		size_t e = (s+1)%count;
+		float x0 = points[s*2], y0 = points[s*2+1];
+		float x1 = points[e*2], y1 = points[e*2+1];
+		float dx = x1-x0, dy = y1-y0;
+		float length = sqrtf(dx*dx+dy*dy);
+		dx /= length;
+		dy /= length;
+		float ox = -dy*halfx, oy = dx*halfy;
+		uint32_t a = add_vertex(x0+ox, y0+oy);
+		uint32_t b = add_vertex(x0-ox, y0-oy);
+		uint32_t c = add_vertex(x1-ox, y1-oy);
+		uint32_t d = add_vertex(x1+ox, y1+oy);
+		add_triangle(a, b, c);
+		add_triangle(a, c, d);
+		if(s==0) {
+			firstx = dx;
+			firsty = dy;
+		} else if(!hairline) {
+			add_join(style.JoinStyle, x0, y0, lastx, lasty, dx, dy, style.MiterLimitFactor);
+		}
+		lastx = dx;
+		lasty = dy;
+	}
+	if(hairline)
+		return;
+	if(closed) {
+		add_join(style.JoinStyle, points[0], points[1], lastx, lasty, firstx, firsty, style.MiterLimitFactor);
+	} else {
+		add_cap(style.StartCapStyle, points[0], points[1], -firstx, -firsty);
+		add_cap(style.EndCapStyle, points[count*2-2], points[count*2-1], lastx, lasty);
+	}
+}
+
+void Stroker::add_cap(LineStyle::Cap cap, float x, float y, float dx, float dy)
+{
+	// (dx,dy) is the unit direction pointing away from the line
+	float nx = -dy, ny = dx;
+	switch(cap) {
+	case LineStyle::Cap::ROUND:
+		add_arc(x, y, atan2f(ny, nx), -STROKE_PI);
+		break;
+	case LineStyle::Cap::SQUARE:
+	{
+		float ox = nx*halfx, oy = ny*halfy;
+		float ex = dx*halfx, ey = dy*halfy;
+		uint32_t a = add_vertex(x+ox, y+oy);
+		uint32_t b = add_vertex(x-ox, y-oy);
+		uint32_t c = add_vertex(x-ox+ex, y-oy+ey);
+		uint32_t d = add_vertex(x+ox+ex, y+oy+ey);
+		add_triangle(a, b, c);
+		add_triangle(a, c, d);
+		break;
+	}
+	case LineStyle::Cap::NONE:
+		break;
+	}
+}
+
+void Stroker::add_join(LineStyle::Join join, float x, float y, float ax, float ay, float bx, float by, float miterlimit)
+{
+	// (ax,ay) and (bx,by) are the unit directions into and out of the corner
+	float cross = ax*by-ay*bx;
+	float dot = ax*bx+ay*by;
+	if(fabsf(cross)<1e-6f && dot>0.0f)
+		return;	// No turn, nothing to fill
+	float side = (cross>0.0f) ? -1.0f : 1.0f;	// Normals on the outside of the turn
+	float n0x = -ay*side, n0y = ax*side;
+	float n1x = -by*side, n1y = bx*side;
+	if(join==LineStyle::Join::ROUND) {
+		add_arc(x, y, atan2f(n0y, n0x), atan2f(n0x*n1y-n0y*n1x, n0x*n1x+n0y*n1y));
+		return;
+	}
+	uint32_t centre = add_vertex(x, y);
+	uint32_t a = add_vertex(x+n0x*halfx, y+n0y*halfy);
+	uint32_t b = add_vertex(x+n1x*halfx, y+n1y*halfy);
+	if(join==LineStyle::Join::MITER) {
+		float mx = n0x+n1x, my = n0y+n1y;
+		float length = sqrtf(mx*mx+my*my);
+		if(length>1e-6f) {
+			mx /= length;
+			my /= length;
+			float cosine = mx*n0x+my*n0y;	// Cosine of half the angle between the offset edges
+			if(cosine>0.0f && 1.0f/cosine<=std::max(miterlimit, 1.0f)) {
+				uint32_t tip = add_vertex(x+mx/cosine*halfx, y+my/cosine*halfy);
+				add_triangle(centre, a, tip);
+				add_triangle(centre, tip, b);
+				return;
+			}
+		}
+	}
+	add_triangle(centre, a, b);	// Bevel, or a miter past its limit
+}
+
+void Stroker::add_arc(float x, float y, float angle, float sweep)
+{
+	// Enough steps that no chord strays more than the tolerance from the stroke's edge on screen
+	float radius = std::max(halfx*scalex, halfy*scaley);
+	uint32_t steps = 1;
+	if(radius>tolerance) {
+		float step = 2.0f*acosf(1.0f-tolerance/radius);
+		steps = (uint32_t)std::min(ceilf(fabsf(sweep)/step), (float)STROKE_MAX_ARC_STEPS);
+		steps = std::max(steps, 1u);
+	}
+	uint32_t centre = add_vertex(x, y);
+	uint32_t previous = add_vertex(x+cosf(angle)*halfx, y+sinf(angle)*halfy);
+	for(uint32_t i=1; i<=steps; i++) {
+		float a = angle + sweep*i/steps;
+		uint32_t current = add_vertex(x+cosf(a)*halfx, y+sinf(a)*halfy);
+		add_triangle(centre, previous, current);
+		previous = current;
+	}
+}
+
+uint32_t Stroker::add_vertex(float x, float y)
+{
+	uint32_t index = (uint32_t)(mesh->vertices.size()/2);
+	mesh->vertices.push_back(x);
+	mesh->vertices.push_back(y);
+	return index;
+}
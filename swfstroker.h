@@ -0,0 +1,58 @@
+#ifndef LIBSHOCKWAVE_SWF_STROKER_H
+#define LIBSHOCKWAVE_SWF_STROKER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "swftypedefs.h"
+#include "swfflatten.h"
+#include "swftessellator.h"
+
+namespace SWF
+{
+
+	// Expands a character's stroked runs into triangles, following each LineStyle's width, caps,
+	// joins and miter limit. Connected runs that share a line style are stroked as one polyline so
+	// they get joins rather than caps. Strokes thinner than a screen pixel, or of zero width, take
+	// a hairline path of one pixel quads with no joins or caps. Keeps its buffers between calls;
+	// use one per thread.
+	class Stroker
+	{
+		struct Polyline
+		{
+			uint16_t stroke;
+			uint8_t layer;
+			uint32_t offset;	// Range in the vertex buffer
+			uint32_t count;
+		};
+		float tolerance;
+		Matrix transform;
+		float scalex, scaley;	// Length of the transform's axes
+		float halfx, halfy;	// Half the stroke width along each axis, in character space
+		Flattener flattener;
+		std::vector<Vertex> vertices;
+		std::vector<Polyline> polylines;
+		std::vector<float> points;
+		Mesh *mesh;
+
+		void set_width(const LineStyle&, bool&);
+		void stroke_polyline(const LineStyle&);
+		void add_cap(LineStyle::Cap, float, float, float, float);
+		void add_join(LineStyle::Join, float, float, float, float, float, float, float);
+		void add_arc(float, float, float, float);
+		uint32_t add_vertex(float, float);
+		void add_triangle(uint32_t a, uint32_t b, uint32_t c) { mesh->indices.push_back(a); mesh->indices.push_back(b); mesh->indices.push_back(c); }
+
+	public:
+		Stroker(float tolerance=0.25f);	// Maximum distance in screen pixels between a curve and its segments
+		void set_tolerance(float t) { tolerance = t; }
+		float get_tolerance() { return tolerance; }
+		// Appends one batch per line style to the mesh. The matrix decides curve detail and how
+		// non-scaling strokes are sized; the triangles stay in character space.
+		void stroke(const Character&, const LineStyleArray&, Mesh&, const Matrix &m=Matrix());
+	};
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_STROKER_H
@@ -0,0 +1,198 @@
+#include "swftessellator.h"
+#include "swfstroker.h"
+#include "swfthreadpool.h"
+#include <algorithm>
+#include <cmath>
+using namespace SWF;
+
+Tessellator::Tessellator(float t)
+{
+	tolerance = t;
+}
+
+void Tessellator::tessellate(const Character &character, Mesh &mesh, const Matrix &m)
+{
+	mesh.clear();
+	transform = m;
+	paths.build(character, fillpaths);
+	for(const FillPath &path : fillpaths.fills) {
+		edges.clear();
+		for(const Contour &contour : path.contours) {
+			points.clear();
+			flattener.flatten(&fillpaths.vertices[contour.offset], contour.count, transform, tolerance, points);
+			add_edges();
+		}
+		MeshBatch batch;
+		batch.fill = path.fill;
+		batch.layer = path.layer;
+		batch.offset = (uint32_t)mesh.indices.size();
+		sweep(character.fillrule, mesh);
+		batch.count = (uint32_t)mesh.indices.size()-batch.offset;
+		if(batch.count)
+			mesh.batches.push_back(batch);
+	}
+}
+
+void Tessellator::add_edges()
+{
+	size_t count = points.size()/2;
+	if(count<2)
+		return;
+	for(size_t i=0; i<count; i++) {
+		size_t j = (i+1<count) ? i+1 : 0;	// Open contours are closed back to their start
+		float x0 = points[i*2], y0 = points[i*2+1];
+		float x1 = points[j*2], y1 = points[j*2+1];
+		if(y0==y1)
+			continue;	// Horizontal edges never cross a scanline
+		Edge e;
+		e.winding = (y0<y1) ? 1 : -1;
+		if(y0>y1) {
+			std::swap(x0, x1);
+			std::swap(y0, y1);
+		}
+		e.x0 = x0; e.y0 = y0;
+		e.x1 = x1; e.y1 = y1;
+		e.dxdy = (x1-x0)/(y1-y0);
+		e.cachey[0] = e.cachey[1] = -INFINITY;
+		edges.push_back(e);
+	}
+}
+
+void Tessellator::sweep(FillRule rule, Mesh &mesh)
+{
+	if(edges.size()<2)
+		return;
+	std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.y0<b.y0; });
+	heights.clear();
+	for(const Edge &e : edges) {
+		heights.push_back(e.y0);
+		heights.push_back(e.y1);
+	}
+	std::sort(heights.begin(), heights.end());
+	heights.erase(std::unique(heights.begin(), heights.end()), heights.end());
+
+	active.clear();
+	size_t nextedge = 0;
+	for(size_t h=0; h+1<heights.size(); h++) {
+		float top = heights[h];
+		float bottom = heights[h+1];
+		active.erase(std::remove_if(active.begin(), active.end(), [top](const Edge *e) { return e->y1<=top; }), active.end());
+		while(nextedge<edges.size() && edges[nextedge].y0<=top) {
+			if(edges[nextedge].y1>top)
+				active.push_back(&edges[nextedge]);
+			nextedge++;
+		}
+		if(active.size()<2)
+			continue;
+		emit_band(top, bottom, rule, mesh);
+	}
+}
+
+void Tessellator::emit_band(float top, float bottom, FillRule rule, Mesh &mesh)
+{
+	while(top<bottom) {
+		// Order the edges across the band and shorten it to the first place two neighbours cross,
+		// repeating until the band holds no crossings so the order is valid over all of it
+		float end = bottom;
+		while(true) {
+			float mid = (top+end)*0.5f;
+			spans.clear();
+			for(const Edge *e : active)
+				spans.push_back({ e->x_at(top), e->x_at(end), e->x_at(mid), e });
+			std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) { return a.mid<b.mid; });
+			float crossing = end;
+			for(size_t i=0; i+1<spans.size(); i++) {
+				const Span &a = spans[i];
+				const Span &b = spans[i+1];
+				if(a.top<=b.top && a.bottom<=b.bottom)
+					continue;
+				float slope = a.edge->dxdy-b.edge->dxdy;
+				if(slope==0.0f)
+					continue;
+				float y = top + (b.top-a.top)/slope;
+				if(y>top+1e-4f && y<crossing-1e-4f)
+					crossing = y;
+			}
+			if(crossing==end)
+				break;
+			end = crossing;
+		}
+
+		int winding = 0;
+		for(size_t i=0; i+1<spans.size(); i++) {
+			winding += spans[i].edge->winding;
+			bool inside = (rule==FillRule::NON_ZERO) ? (winding!=0) : ((winding&1)!=0);
+			if(!inside)
+				continue;
+			const Span &left = spans[i];
+			const Span &right = spans[i+1];
+			bool topwidth = (right.top-left.top>0.0f);
+			bool bottomwidth = (right.bottom-left.bottom>0.0f);
+			if(!topwidth && !bottomwidth)
+				continue;	// Zero-width trapezoid
+			uint32_t topleft = edge_vertex(left.edge, left.top, top, mesh);
+			uint32_t topright = edge_vertex(right.edge, right.top, top, mesh);
+			uint32_t bottomright = edge_vertex(right.edge, right.bottom, end, mesh);
+			uint32_t bottomleft = edge_vertex(left.edge, left.bottom, end, mesh);
+			if(topwidth) {
+				uint32_t tri[3] = { topleft, topright, bottomright };
+				mesh.indices.insert(mesh.indices.end(), tri, tri+3);
+			}
+			if(bottomwidth) {
+				uint32_t tri[3] = { topleft, bottomright, bottomleft };
+				mesh.indices.insert(mesh.indices.end(), tri, tri+3);
+			}
+		}
+		top = end;
+	}
+}
+
+// The sweep only moves down, so an edge is asked for at most its band's top and bottom before
+// moving on; the older of its two cached vertices is the one to replace
+uint32_t Tessellator::edge_vertex(const Edge *e, float x, float y, Mesh &mesh)
+{
+	for(int i=0; i<2; i++) {
+		if(e->cachey[i]==y)
+			return e->cachevertex[i];
+	}
+	int slot = (e->cachey[0]<e->cachey[1]) ? 0 : 1;
+	e->cachey[slot] = y;
+	e->cachevertex[slot] = (uint32_t)(mesh.vertices.size()/2);
+	mesh.vertices.push_back(x);
+	mesh.vertices.push_back(y);
+	return e->cachevertex[slot];
+}
+
+void SWF::tessellate_character(Tessellator &tessellator, Stroker &stroker, const Character &character, const LineStyleArray *lines, Mesh &mesh, const Matrix &m)
+{
+	tessellator.tessellate(character, mesh, m);
+	if(lines) {
+		stroker.stroke(character, *lines, mesh, m);
+		std::stable_sort(mesh.batches.begin(), mesh.batches.end(), [](const MeshBatch &a, const MeshBatch &b) { return a.layer<b.layer; });
+	}
+}
+
+void SWF::tessellate_characters(Dictionary *dict, MeshMap &meshes, float tolerance, unsigned threads)
+{
+	struct Work
+	{
+		uint16_t id;
+		const Character *character;
+		const LineStyleArray *lines;
+	};
+	std::vector<Work> work;
+	for(CharacterDict::iterator it=dict->CharacterList.begin(); it!=dict->CharacterList.end(); ++it) {
+		LineStyleMap::iterator lines = dict->LineStyles.find(it->first);	// Looked up here; operator[] would insert from several threads
+		work.push_back({ it->first, &it->second, (lines!=dict->LineStyles.end()) ? &lines->second : NULL });
+	}
+	std::vector<Mesh> results(work.size());
+
+	ThreadPool pool(threads);
+	std::vector<Tessellator> tessellators(pool.size(), Tessellator(tolerance));
+	std::vector<Stroker> strokers(pool.size(), Stroker(tolerance));
+	pool.parallel_for(work.size(), [&](size_t i, unsigned worker) {
+		tessellate_character(tessellators[worker], strokers[worker], *work[i].character, work[i].lines, results[i]);
+	});
+	for(size_t i=0; i<work.size(); i++)
+		meshes[work[i].id] = std::move(results[i]);
+}
@@ -0,0 +1,90 @@
+#ifndef LIBSHOCKWAVE_SWF_TESSELLATOR_H
+#define LIBSHOCKWAVE_SWF_TESSELLATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "swftypedefs.h"
+#include "swfpaths.h"
+#include "swfflatten.h"
+
+namespace SWF
+{
+
+	// A range of Mesh::indices drawn with one style
+	struct MeshBatch
+	{
+		uint16_t fill = 0;	// 1-based index into the character's FillStyleArray
+		uint16_t stroke = 0;	// 1-based index into the character's LineStyleArray, for stroke batches
+		uint8_t layer = 0;
+		uint32_t offset = 0;
+		uint32_t count = 0;
+	};
+	struct Mesh
+	{
+		std::vector<float> vertices;	// Interleaved x,y in pixels
+		std::vector<uint32_t> indices;	// Triangle list
+		std::vector<MeshBatch> batches;
+		void clear() { vertices.clear(); indices.clear(); batches.clear(); }
+		size_t get_bytes() const { return vertices.size()*sizeof(float) + indices.size()*sizeof(uint32_t) + batches.size()*sizeof(MeshBatch); }
+	};
+	typedef IdTable<Mesh> MeshMap;
+
+	// Turns a character's fills into triangles by sweeping each fill's flattened contours into
+	// trapezoids between consecutive vertex heights, honouring the character's winding rule.
+	// Trapezoids that meet on an edge at a band boundary share the vertex there.
+	// Working buffers are kept between calls, so give every thread its own Tessellator.
+	class Tessellator
+	{
+		struct Edge
+		{
+			float x0, y0;	// Always the upper end
+			float x1, y1;
+			float dxdy;
+			int8_t winding;
+			mutable float cachey[2];			// The last two band boundaries the edge was cut at,
+			mutable uint32_t cachevertex[2];	// and the vertices made there
+			float x_at(float y) const { return x0 + (y-y0)*dxdy; }
+		};
+		struct Span
+		{
+			float top, bottom, mid;
+			const Edge *edge;
+		};
+		float tolerance;
+		Matrix transform;
+		PathBuilder paths;
+		FillPaths fillpaths;
+		Flattener flattener;
+		std::vector<float> points;
+		std::vector<Edge> edges;
+		std::vector<float> heights;
+		std::vector<const Edge*> active;
+		std::vector<Span> spans;
+
+		void add_edges();
+		void sweep(FillRule, Mesh&);
+		void emit_band(float, float, FillRule, Mesh&);
+		uint32_t edge_vertex(const Edge*, float, float, Mesh&);
+
+	public:
+		Tessellator(float tolerance=0.25f);	// Maximum distance in screen pixels between a curve and its segments
+		void set_tolerance(float t) { tolerance = t; }
+		float get_tolerance() { return tolerance; }
+		// The matrix is only used to judge how finely to flatten curves; the mesh stays in character space
+		void tessellate(const Character&, Mesh&, const Matrix &m=Matrix());
+	};
+
+	class Stroker;
+
+	// Tessellates one character's fills, then strokes it when it has line styles, ordering the batches by layer
+	void tessellate_character(Tessellator&, Stroker&, const Character&, const LineStyleArray*, Mesh&, const Matrix &m=Matrix());
+
+	// Tessellates the fills and strokes of every character in the dictionary, spread over a thread
+	// pool (0 threads uses every core). Each mesh's batches are ordered by layer, fills before strokes.
+	void tessellate_characters(Dictionary*, MeshMap&, float tolerance=0.25f, unsigned threads=0);
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_TESSELLATOR_H
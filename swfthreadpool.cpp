@@ -0,0 +1,69 @@
+#include "swfthreadpool.h"
+using namespace SWF;
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+	if(threads==0)
+		threads = std::thread::hardware_concurrency();
+	jobcount = 0;
+	next = 0;
+	active = 0;
+	generation = 0;
+	stop = false;
+	for(unsigned i=1; i<threads; i++)
+		workers.push_back(std::thread(&ThreadPool::work, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	for(size_t i=0; i<workers.size(); i++)
+		workers[i].join();
+}
+
+void ThreadPool::run(unsigned worker)
+{
+	for(size_t i=next.fetch_add(1); i<jobcount; i=next.fetch_add(1))
+		job(i, worker);
+}
+
+void ThreadPool::work(unsigned worker)
+{
+	uint64_t seen = 0;
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]{ return stop || generation!=seen; });
+			if(stop)
+				return;
+			seen = generation;
+		}
+		run(worker);
+		std::lock_guard<std::mutex> lock(mutex);
+		if(--active==0)
+			finished.notify_one();
+	}
+}
+
+void ThreadPool::parallel_for(size_t count, std::function<void(size_t,unsigned)> fn)
+{
+	if(count==0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = fn;
+		jobcount = count;
+		next = 0;
+		active = (unsigned)workers.size();
+		generation++;
+	}
+	wake.notify_all();
+	run(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [&]{ return active==0; });
+	job = nullptr;
+}
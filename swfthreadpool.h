@@ -0,0 +1,44 @@
+#ifndef LIBSHOCKWAVE_SWF_THREADPOOL_H
+#define LIBSHOCKWAVE_SWF_THREADPOOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+
+namespace SWF
+{
+
+	class ThreadPool
+	{
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable finished;
+		std::function<void(size_t,unsigned)> job;
+		size_t jobcount;
+		std::atomic<size_t> next;
+		unsigned active;
+		uint64_t generation;
+		bool stop;
+
+		void work(unsigned);
+		void run(unsigned);
+
+	public:
+		ThreadPool(unsigned threads=0);	// 0 uses one thread per hardware core
+		~ThreadPool();
+		unsigned size() { return (unsigned)workers.size()+1; }	// Includes the thread calling parallel_for
+
+		// Calls the job once for every index in [0,count), passing the index and a worker number
+		// below size() that can select per-thread state. Runs one batch at a time and blocks until it is done.
+		void parallel_for(size_t, std::function<void(size_t,unsigned)>);
+	};
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_THREADPOOL_H
@@ -0,0 +1,212 @@
+#include "swftransform.h"
+#include "swfsimd.h"
+#include <algorithm>
+#include <cmath>
+#ifdef LIBSHOCKWAVE_SSE2
+	#include <emmintrin.h>
+#endif
+#ifdef LIBSHOCKWAVE_AVX2
+	#include <immintrin.h>
+#endif
+using namespace SWF;
+
+static_assert(sizeof(Rect)==4*sizeof(Coord), "Rects are processed as four packed Coords");
+
+// Points. The scalar kernel finishes the tails of the vector ones, so it keeps their order of operations.
+static void points_scalar(const Matrix &m, const Coord *x, const Coord *y, float *outx, float *outy, size_t count)
+{
+	float tx = coord_to_float(m.TranslateX), ty = coord_to_float(m.TranslateY);
+	for(size_t i=0; i<count; i++) {
+		float px = coord_to_float(x[i]), py = coord_to_float(y[i]);
+		outx[i] = (m.ScaleX*px + m.RotateSkew1*py) + tx;
+		outy[i] = (m.RotateSkew0*px + m.ScaleY*py) + ty;
+	}
+}
+
+#ifdef LIBSHOCKWAVE_SSE2
+static inline __m128 load_coords_sse2(const Coord *c)
+{
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+	return _mm_div_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)c)), _mm_set1_ps(20.0f));
+#else
+	return _mm_loadu_ps(c);
+#endif
+}
+
+static void points_sse2(const Matrix &m, const Coord *x, const Coord *y, float *outx, float *outy, size_t count)
+{
+	const __m128 a = _mm_set1_ps(m.ScaleX), b = _mm_set1_ps(m.RotateSkew0);
+	const __m128 c = _mm_set1_ps(m.RotateSkew1), d = _mm_set1_ps(m.ScaleY);
+	const __m128 tx = _mm_set1_ps(coord_to_float(m.TranslateX)), ty = _mm_set1_ps(coord_to_float(m.TranslateY));
+	size_t i = 0;
+	for(; i+4<=count; i+=4) {
+		__m128 px = load_coords_sse2(x+i), py = load_coords_sse2(y+i);
+		_mm_storeu_ps(outx+i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, px), _mm_mul_ps(c, py)), tx));
+		_mm_storeu_ps(outy+i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(b, px), _mm_mul_ps(d, py)), ty));
+	}
+	points_scalar(m, x+i, y+i, outx+i, outy+i, count-i);
+}
+#endif
+
+#ifdef LIBSHOCKWAVE_AVX2
+LIBSHOCKWAVE_TARGET_AVX2 static inline __m256 load_coords_avx2(const Coord *c)
+{
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+	return _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)c)), _mm256_set1_ps(20.0f));
+#else
+	return _mm256_loadu_ps(c);
+#endif
+}
+
+LIBSHOCKWAVE_TARGET_AVX2 static void points_avx2(const Matrix &m, const Coord *x, const Coord *y, float *outx, float *outy, size_t count)
+{
+	const __m256 a = _mm256_set1_ps(m.ScaleX), b = _mm256_set1_ps(m.RotateSkew0);
+	const __m256 c = _mm256_set1_ps(m.RotateSkew1), d = _mm256_set1_ps(m.ScaleY);
+	const __m256 tx = _mm256_set1_ps(coord_to_float(m.TranslateX)), ty = _mm256_set1_ps(coord_to_float(m.TranslateY));
+	size_t i = 0;
+	for(; i+8<=count; i+=8) {
+		__m256 px = load_coords_avx2(x+i), py = load_coords_avx2(y+i);
+		_mm256_storeu_ps(outx+i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, px), _mm256_mul_ps(c, py)), tx));
+		_mm256_storeu_ps(outy+i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b, px), _mm256_mul_ps(d, py)), ty));
+	}
+	points_scalar(m, x+i, y+i, outx+i, outy+i, count-i);
+}
+#endif
+
+void SWF::transform_points(const Matrix &m, const Coord *x, const Coord *y, float *outx, float *outy, size_t count)
+{
+#ifdef LIBSHOCKWAVE_AVX2
+	if(cpu_has_avx2()) {
+		points_avx2(m, x, y, outx, outy, count);
+		return;
+	}
+#endif
+#ifdef LIBSHOCKWAVE_SSE2
+	points_sse2(m, x, y, outx, outy, count);
+#else
+	points_scalar(m, x, y, outx, outy, count);
+#endif
+}
+
+
+
+// Rects. Each axis of the result is the translation plus, for each input axis, the smaller or
+// larger of the matrix term times that axis' two bounds. The work stays in Coord units.
+static Rect rect_scalar(const Matrix &m, const Rect &r)
+{
+	float ax0 = m.ScaleX*(float)r.xmin, ax1 = m.ScaleX*(float)r.xmax;
+	float cy0 = m.RotateSkew1*(float)r.ymin, cy1 = m.RotateSkew1*(float)r.ymax;
+	float bx0 = m.RotateSkew0*(float)r.xmin, bx1 = m.RotateSkew0*(float)r.xmax;
+	float dy0 = m.ScaleY*(float)r.ymin, dy1 = m.ScaleY*(float)r.ymax;
+	float xmin = (std::min(ax0, ax1) + std::min(cy0, cy1)) + (float)m.TranslateX;
+	float xmax = (std::max(ax0, ax1) + std::max(cy0, cy1)) + (float)m.TranslateX;
+	float ymin = (std::min(bx0, bx1) + std::min(dy0, dy1)) + (float)m.TranslateY;
+	float ymax = (std::max(bx0, bx1) + std::max(dy0, dy1)) + (float)m.TranslateY;
+	Rect out;
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+	out.xmin = (Coord)floorf(xmin);
+	out.xmax = (Coord)ceilf(xmax);
+	out.ymin = (Coord)floorf(ymin);
+	out.ymax = (Coord)ceilf(ymax);
+#else
+	out.xmin = xmin;
+	out.xmax = xmax;
+	out.ymin = ymin;
+	out.ymax = ymax;
+#endif
+	return out;
+}
+
+static void rects_scalar(const Matrix &m, const Rect *in, Rect *out, size_t count)
+{
+	for(size_t i=0; i<count; i++)
+		out[i] = rect_scalar(m, in[i]);
+}
+
+#ifdef LIBSHOCKWAVE_SSE2
+// One rect per vector, as xmin, xmax, ymin, ymax
+static void rects_sse2(const Matrix &m, const Rect *in, Rect *out, size_t count)
+{
+	const __m128 mx = _mm_setr_ps(m.ScaleX, m.ScaleX, m.RotateSkew1, m.RotateSkew1);
+	const __m128 my = _mm_setr_ps(m.RotateSkew0, m.RotateSkew0, m.ScaleY, m.ScaleY);
+	const __m128 t = _mm_setr_ps((float)m.TranslateX, (float)m.TranslateX, (float)m.TranslateY, (float)m.TranslateY);
+	const __m128 upper = _mm_castsi128_ps(_mm_setr_epi32(0, -1, 0, -1));	// Lanes holding a maximum
+	for(size_t i=0; i<count; i++) {
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+		__m128 v = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&in[i]));
+#else
+		__m128 v = _mm_loadu_ps(&in[i].xmin);
+#endif
+		__m128 p = _mm_mul_ps(v, mx), q = _mm_mul_ps(v, my);
+		__m128 ps = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2,3,0,1)), qs = _mm_shuffle_ps(q, q, _MM_SHUFFLE(2,3,0,1));
+		p = _mm_or_ps(_mm_andnot_ps(upper, _mm_min_ps(p, ps)), _mm_and_ps(upper, _mm_max_ps(p, ps)));
+		q = _mm_or_ps(_mm_andnot_ps(upper, _mm_min_ps(q, qs)), _mm_and_ps(upper, _mm_max_ps(q, qs)));
+		p = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1,0,3,2)));
+		q = _mm_add_ps(q, _mm_shuffle_ps(q, q, _MM_SHUFFLE(1,0,3,2)));
+		__m128 r = _mm_add_ps(_mm_shuffle_ps(p, q, _MM_SHUFFLE(1,0,1,0)), t);
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+		// Round minimums down and maximums up; SSE2 has no floor, so correct the truncation
+		__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(r));
+		__m128 down = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, r), _mm_set1_ps(1.0f)));
+		__m128 up = _mm_add_ps(truncated, _mm_and_ps(_mm_cmplt_ps(truncated, r), _mm_set1_ps(1.0f)));
+		r = _mm_or_ps(_mm_andnot_ps(upper, down), _mm_and_ps(upper, up));
+		_mm_storeu_si128((__m128i*)&out[i], _mm_cvttps_epi32(r));
+#else
+		_mm_storeu_ps(&out[i].xmin, r);
+#endif
+	}
+}
+#endif
+
+#ifdef LIBSHOCKWAVE_AVX2
+// Two rects per vector, one in each 128-bit lane, so every shuffle stays within its lane
+LIBSHOCKWAVE_TARGET_AVX2 static void rects_avx2(const Matrix &m, const Rect *in, Rect *out, size_t count)
+{
+	const __m256 mx = _mm256_setr_ps(m.ScaleX, m.ScaleX, m.RotateSkew1, m.RotateSkew1, m.ScaleX, m.ScaleX, m.RotateSkew1, m.RotateSkew1);
+	const __m256 my = _mm256_setr_ps(m.RotateSkew0, m.RotateSkew0, m.ScaleY, m.ScaleY, m.RotateSkew0, m.RotateSkew0, m.ScaleY, m.ScaleY);
+	const float tx = (float)m.TranslateX, ty = (float)m.TranslateY;
+	const __m256 t = _mm256_setr_ps(tx, tx, ty, ty, tx, tx, ty, ty);
+	size_t i = 0;
+	for(; i+2<=count; i+=2) {
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+		__m256 v = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)&in[i]));
+#else
+		__m256 v = _mm256_loadu_ps(&in[i].xmin);
+#endif
+		__m256 p = _mm256_mul_ps(v, mx), q = _mm256_mul_ps(v, my);
+		__m256 ps = _mm256_permute_ps(p, _MM_SHUFFLE(2,3,0,1)), qs = _mm256_permute_ps(q, _MM_SHUFFLE(2,3,0,1));
+		p = _mm256_blend_ps(_mm256_min_ps(p, ps), _mm256_max_ps(p, ps), 0xAA);
+		q = _mm256_blend_ps(_mm256_min_ps(q, qs), _mm256_max_ps(q, qs), 0xAA);
+		p = _mm256_add_ps(p, _mm256_permute_ps(p, _MM_SHUFFLE(1,0,3,2)));
+		q = _mm256_add_ps(q, _mm256_permute_ps(q, _MM_SHUFFLE(1,0,3,2)));
+		__m256 r = _mm256_add_ps(_mm256_shuffle_ps(p, q, _MM_SHUFFLE(1,0,1,0)), t);
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+		r = _mm256_blend_ps(_mm256_floor_ps(r), _mm256_ceil_ps(r), 0xAA);
+		_mm256_storeu_si256((__m256i*)&out[i], _mm256_cvttps_epi32(r));
+#else
+		_mm256_storeu_ps(&out[i].xmin, r);
+#endif
+	}
+	rects_scalar(m, in+i, out+i, count-i);
+}
+#endif
+
+void SWF::transform_rects(const Matrix &m, const Rect *in, Rect *out, size_t count)
+{
+#ifdef LIBSHOCKWAVE_AVX2
+	if(cpu_has_avx2()) {
+		rects_avx2(m, in, out, count);
+		return;
+	}
+#endif
+#ifdef LIBSHOCKWAVE_SSE2
+	rects_sse2(m, in, out, count);
+#else
+	rects_scalar(m, in, out, count);
+#endif
+}
+
+Rect SWF::transform_rect(const Matrix &m, const Rect &r)
+{
+	return rect_scalar(m, r);
+}
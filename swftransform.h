@@ -0,0 +1,26 @@
+#ifndef LIBSHOCKWAVE_SWF_TRANSFORM_H
+#define LIBSHOCKWAVE_SWF_TRANSFORM_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "swftypedefs.h"
+
+namespace SWF
+{
+
+	// Transforms count points held as separate x and y arrays, such as a VertexPool's planes:
+	// x' = ScaleX*x + RotateSkew1*y + TranslateX, y' = RotateSkew0*x + ScaleY*y + TranslateY.
+	// Results are float pixels whatever Coord is; with float Coords the outputs may be the inputs.
+	// The kernels use AVX2 when the CPU has it and SSE2 otherwise; every path gives the same floats.
+	void transform_points(const Matrix&, const Coord *x, const Coord *y, float *outx, float *outy, size_t count);
+
+	// Bounding boxes of count rectangles after transforming them, as tight as the four
+	// transformed corners. With integer Coords the bounds are rounded outwards to whole twips.
+	// out may be in.
+	void transform_rects(const Matrix&, const Rect *in, Rect *out, size_t count);
+	Rect transform_rect(const Matrix&, const Rect&);
+
+}
+
+#endif //LIBSHOCKWAVE_SWF_TRANSFORM_H
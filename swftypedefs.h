@@ -2,9 +2,13 @@
 #define LIBSHOCKWAVE_SWF_TYPEDEFS_H
 
 #include <cstdint>
+#include <cstddef>
 #include <vector>
-#include <list>
 #include <map>
+#include <bitset>
+#include <memory>
+#include <utility>
+#include <type_traits>
 
 namespace SWF
 {
@@ -29,18 +33,131 @@ namespace SWF
 		LINEAR_RGB
 	};
 
+	// Table keyed by 16-bit character id. Ids are split into a page number and a slot, and each
+	// page of 256 entries is allocated in one block the first time one of its ids is used.
+	template<typename T> class IdTable
+	{
+	public:
+		typedef std::pair<uint16_t,T> value_type;	// Same shape as std::map entries
+
+	private:
+		struct Page
+		{
+			value_type items[256];
+			std::bitset<256> present;
+		};
+		std::unique_ptr<Page> pages[256];
+		size_t entries = 0;
+
+		bool has(uint32_t id) const { return pages[id>>8] && pages[id>>8]->present[id&0xFF]; }
+		uint32_t next_id(uint32_t id) const
+		{
+			while(id<0x10000) {
+				if(!pages[id>>8])	id = (id|0xFF)+1;
+				else if(has(id))	return id;
+				else				id++;
+			}
+			return id;
+		}
+
+	public:
+		class iterator
+		{
+			IdTable *table;
+			uint32_t id;
+		public:
+			iterator(IdTable *t, uint32_t i) : table(t), id(i) {}
+			value_type &operator*() const { return table->pages[id>>8]->items[id&0xFF]; }
+			value_type *operator->() const { return &table->pages[id>>8]->items[id&0xFF]; }
+			iterator &operator++() { id = table->next_id(id+1); return *this; }
+			bool operator==(const iterator &other) const { return id==other.id; }
+			bool operator!=(const iterator &other) const { return id!=other.id; }
+			uint32_t get_id() const { return id; }
+		};
+
+		IdTable() {}
+		IdTable(const IdTable &other) { *this = other; }
+		IdTable &operator=(const IdTable &other)
+		{
+			if(this==&other)	return *this;
+			for(int i=0; i<256; i++)
+				pages[i].reset(other.pages[i] ? new Page(*other.pages[i]) : NULL);
+			entries = other.entries;
+			return *this;
+		}
+
+		T &operator[](uint16_t id)
+		{
+			std::unique_ptr<Page> &page = pages[id>>8];
+			if(!page)	page.reset(new Page());
+			if(!page->present[id&0xFF]) {
+				page->present[id&0xFF] = true;
+				page->items[id&0xFF].first = id;
+				entries++;
+			}
+			return page->items[id&0xFF].second;
+		}
+		iterator find(uint16_t id) { return has(id) ? iterator(this, id) : end(); }
+		size_t count(uint16_t id) const { return has(id) ? 1 : 0; }
+		size_t size() const { return entries; }
+		bool empty() const { return entries==0; }
+		iterator begin() { return iterator(this, next_id(0)); }
+		iterator end() { return iterator(this, 0x10000); }
+		void erase(iterator it) { erase((uint16_t)it.get_id()); }
+		void erase(uint16_t id)
+		{
+			if(!has(id))	return;
+			pages[id>>8]->present[id&0xFF] = false;
+			pages[id>>8]->items[id&0xFF].second = T();
+			entries--;
+		}
+		void clear()
+		{
+			for(int i=0; i<256; i++)
+				pages[i].reset();
+			entries = 0;
+		}
+	};
+
 	struct RecordHeader
 	{
 		uint16_t tag : 10;
 		uint32_t length;
 	};
 
+	struct TagIndexEntry
+	{
+		uint16_t tag = 0;
+		uint16_t characterid = 0;
+		uint32_t offset = 0;	// Start of the tag body in the uncompressed stream
+		uint32_t length = 0;
+		bool decoded = false;	// Set once Parser::get_character has read it, even if it held no character
+	};
+	typedef std::vector<TagIndexEntry> TagIndex;
+
+	// Geometry is stored in pixels as float by default. Building with LIBSHOCKWAVE_INTEGER_TWIPS
+	// keeps the file's integer twips (1/20 pixel) instead, so decoding needs no division and
+	// endpoint comparisons are exact; convert with coord_to_float() when exporting.
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+	typedef int32_t Coord;
+	constexpr Coord twips_to_coord(int32_t twips) { return twips; }
+	constexpr int32_t coord_to_twips(Coord c) { return c; }
+	constexpr float coord_to_float(Coord c) { return c/20.0f; }
+	constexpr Coord round_coord(float c) { return Coord(c<0.0f ? c-0.5f : c+0.5f); }	// Nearest whole twip
+#else
+	typedef float Coord;
+	constexpr Coord twips_to_coord(int32_t twips) { return twips/20.0f; }
+	constexpr int32_t coord_to_twips(Coord c) { return int32_t(c<0.0f ? c*20.0f-0.5f : c*20.0f+0.5f); }
+	constexpr float coord_to_float(Coord c) { return c; }
+	constexpr Coord round_coord(float c) { return c; }
+#endif
+
 	struct Rect
 	{
-		float xmin = 0.0f;
-		float xmax = 0.0f;
-		float ymin = 0.0f;
-		float ymax = 0.0f;
+		Coord xmin = 0;
+		Coord xmax = 0;
+		Coord ymin = 0;
+		Coord ymax = 0;
 	};
 
 	struct RGBA
@@ -57,8 +174,8 @@ namespace SWF
 		float ScaleY = 1.0f;
 		float RotateSkew0 = 0.0f;
 		float RotateSkew1 = 0.0f;
-		float TranslateX = 0.0f;
-		float TranslateY = 0.0f;
+		Coord TranslateX = 0;
+		Coord TranslateY = 0;
 	};
 
 	struct CXForm
@@ -71,7 +188,7 @@ namespace SWF
 		int16_t GreenAddTerm = 0;
 		int16_t BlueAddTerm = 0;
 		int16_t AlphaAddTerm = 0;
-		bool IsModified() { return !(
+		bool IsModified() const { return !(
 			(this->RedAddTerm==0 && this->GreenAddTerm==0 && this->BlueAddTerm==0 && this->AlphaAddTerm==0) &&
 			(this->RedMultTerm==1.0f && this->GreenMultTerm==1.0f && this->BlueMultTerm==1.0f && this->AlphaMultTerm==1.0f)
 			); }
@@ -82,12 +199,13 @@ namespace SWF
 		uint8_t Ratio = 0;
 		RGBA Color;
 	};
-	typedef std::list<GradRecord> GradRecordArray;
+	#define GRADIENT_MAX_RECORDS	15	// NumGradients is 4 bits
 	struct Gradient
 	{
 		uint8_t SpreadMode : 2;
 		uint8_t InterpolationMode : 2;
-		GradRecordArray GradientRecords;
+		uint8_t NumGradients = 0;
+		GradRecord GradientRecords[GRADIENT_MAX_RECORDS];	// Inline so that fill styles copy without allocating
 	};
 	struct FocalGradient : public Gradient
 	{
@@ -100,20 +218,21 @@ namespace SWF
 	{
 		enum class Type { SOLID, LINEARGRADIENT=0x10, RADIALGRADIENT=0x12, FOCALRADIALGRADIENT=0x13, REPEATINGBITMAP=0x40, CLIPPEDBITMAP=0x41, NONSMOOTHEDREPEATINGBITMAP=0x42, NONSMOOTHEDCLIPPEDBITMAP=0x43 } StyleType;
 		RGBA Color;
-		Matrix GradientMatrix;
-		Gradient Gradient;
+		Matrix GradientMatrix;	// Gradient square (-16384 to 16384 twips) to shape space
+		FocalGradient Gradient;	// FocalPoint stays 0 unless StyleType is FOCALRADIALGRADIENT
 		uint16_t BitmapId = 0;
 		Matrix BitmapMatrix;
 	};
+	static_assert(std::is_trivially_copyable<FillStyle>::value, "FillStyle must stay trivially copyable");
 	typedef std::vector<FillStyle> FillStyleArray;
-	typedef std::map<uint16_t,FillStyleArray> FillStyleMap;
+	typedef IdTable<FillStyleArray> FillStyleMap;
 
 	struct LineStyle
 	{
 		enum class Type { LINESTYLE, LINESTYLE2 } StyleType;
 		enum class Cap  { ROUND, NONE, SQUARE } StartCapStyle, EndCapStyle;
 		enum class Join { ROUND, BEVEL, MITER } JoinStyle;
-		float Width = 1.0f;
+		Coord Width = twips_to_coord(20);
 		RGBA Color;
 		bool HasFillFlag : 1;
 		bool NoHScaleFlag : 1;
@@ -124,7 +243,7 @@ namespace SWF
 		FillStyle FillType;
 	};
 	typedef std::vector<LineStyle> LineStyleArray;
-	typedef std::map<uint16_t,LineStyleArray> LineStyleMap;
+	typedef IdTable<LineStyleArray> LineStyleMap;
 
 	struct StyleChangeRecord
 	{
@@ -133,8 +252,8 @@ namespace SWF
 		bool FillStyle1Flag = false;
 		bool LineStyleFlag = false;
 		bool NewStylesFlag = false;
-		float MoveDeltaX = 0.0f;
-		float MoveDeltaY = 0.0f;
+		Coord MoveDeltaX = 0;
+		Coord MoveDeltaY = 0;
 		uint16_t FillStyle0 = 0;
 		uint16_t FillStyle1 = 0;
 		uint16_t LineStyle = 0;
@@ -146,12 +265,14 @@ namespace SWF
 
 	struct Point
 	{
-		float x = 0.0f;
-		float y = 0.0f;
-		void transform(Matrix m)
+		Coord x = 0;
+		Coord y = 0;
+		void transform(const Matrix &m)
 		{
-			x = ( x*m.ScaleX ) + ( y*m.RotateSkew1 ) + m.TranslateX;
-			y = ( x*m.RotateSkew0 ) + ( y*m.ScaleY ) + m.TranslateY;
+			float tx = ( x*m.ScaleX ) + ( y*m.RotateSkew1 ) + m.TranslateX;	// Both from the old x and y
+			float ty = ( x*m.RotateSkew0 ) + ( y*m.ScaleY ) + m.TranslateY;
+			x = round_coord(tx);
+			y = round_coord(ty);
 		}
 	};
 	struct Vertex
@@ -159,6 +280,40 @@ namespace SWF
 		Point anchor;
 		Point control;
 	};
+	// All vertices of a character, stored as four planes (anchor x, anchor y, control x,
+	// control y) in a single allocation.
+	class VertexPool
+	{
+		std::vector<Coord> coords;
+		uint32_t count = 0;
+
+	public:
+		uint32_t size() const { return count; }
+		const Coord *anchor_x() const { return coords.data(); }
+		const Coord *anchor_y() const { return coords.data()+count; }
+		const Coord *control_x() const { return coords.data()+2*count; }
+		const Coord *control_y() const { return coords.data()+3*count; }
+		Vertex get(uint32_t i) const
+		{
+			Vertex v;
+			v.anchor.x = coords[i];
+			v.anchor.y = coords[count+i];
+			v.control.x = coords[2*count+i];
+			v.control.y = coords[3*count+i];
+			return v;
+		}
+		void assign(const std::vector<Vertex> &vertices)
+		{
+			count = (uint32_t)vertices.size();
+			coords.resize(4*(size_t)count);
+			for(uint32_t i=0; i<count; i++) {
+				coords[i] = vertices[i].anchor.x;
+				coords[count+i] = vertices[i].anchor.y;
+				coords[2*count+i] = vertices[i].control.x;
+				coords[3*count+i] = vertices[i].control.y;
+			}
+		}
+	};
 	struct Shape
 	{
 		uint8_t layer = 0;
@@ -166,31 +321,103 @@ namespace SWF
 		uint16_t fill1 = 0;
 		uint16_t stroke = 0;
 		bool closed = false;
-		std::vector<Vertex> vertices;
+		uint32_t offset = 0;	// Range of this run in the character's VertexPool
+		uint32_t count = 0;
 	};
 	typedef std::vector<Shape> ShapeList;
+	enum class FillRule { EVEN_ODD, NON_ZERO };
 	struct Character
 	{
 		Rect bounds;
 		ShapeList shapes;
+		VertexPool vertices;
+		FillRule fillrule = FillRule::EVEN_ODD;	// DefineShape4 can ask for non-zero winding
 		bool is_empty() { return !shapes.size(); }
 	};
 	struct DisplayChar
 	{
-		uint16_t id;
+		uint16_t id = 0;
 		Matrix transform;
 		CXForm colourtransform;
 	};
-	typedef std::map<uint16_t,Character> CharacterDict;
+	typedef IdTable<Character> CharacterDict;
 	typedef std::map<uint16_t,DisplayChar> DisplayList;
-	typedef std::list<DisplayList> FrameList;
+
+	struct DisplayChange
+	{
+		enum class Type { PLACE, MODIFY, REMOVE } ChangeType;
+		uint16_t depth = 0;
+		DisplayChar character;	// State of the depth after the change; unused for REMOVE
+	};
+
+	// Frames are stored as the display list changes made in each one, plus a full snapshot
+	// every keyframe interval. Any frame is reached from the snapshot at or before it by
+	// replaying fewer than keyframe interval frames of changes, however long the timeline is.
+	class Timeline
+	{
+		std::vector<DisplayChange> changes;
+		std::vector<uint32_t> framechanges;	// Index of each frame's first entry in changes
+		std::vector<uint32_t> frameoffsets;	// Stream offset of the first tag of each frame
+		std::vector<DisplayList> keyframes;
+		uint16_t keyframeinterval;
+
+	public:
+		Timeline(uint16_t interval=32) { keyframeinterval = interval ? interval : 1; }
+		size_t size() const { return framechanges.size(); }
+		bool empty() const { return framechanges.empty(); }
+
+		void set_keyframe_interval(uint16_t interval) { if(empty()) keyframeinterval = interval ? interval : 1; }
+		uint16_t get_keyframe_interval() const { return keyframeinterval; }
+
+		// Offsets can run ahead of the decoded frames, e.g. after a lazy parse has only indexed the file
+		void set_frame_offset(size_t frame, uint32_t offset)
+		{
+			if(frame>=frameoffsets.size())
+				frameoffsets.resize(frame+1);
+			frameoffsets[frame] = offset;
+		}
+		uint32_t get_frame_offset(size_t frame) const { return frameoffsets[frame]; }
+		size_t get_frame_offset_count() const { return frameoffsets.size(); }
+
+		void add_frame(const std::vector<DisplayChange> &framechangelist, const DisplayList &displaylist)
+		{
+			if(framechanges.size()%keyframeinterval==0)
+				keyframes.push_back(displaylist);
+			framechanges.push_back((uint32_t)changes.size());
+			changes.insert(changes.end(), framechangelist.begin(), framechangelist.end());
+		}
+
+		const std::vector<DisplayChange> &get_changes() const { return changes; }
+		size_t get_change_count(size_t frame) const
+		{
+			size_t end = (frame+1<framechanges.size()) ? framechanges[frame+1] : changes.size();
+			return end-framechanges[frame];
+		}
+		const DisplayChange *get_frame_changes(size_t frame) const { return changes.data()+framechanges[frame]; }
+
+		DisplayList get_frame(size_t frame) const
+		{
+			size_t keyframe = frame/keyframeinterval;
+			DisplayList displaylist = keyframes[keyframe];
+			for(size_t f=keyframe*keyframeinterval+1; f<=frame; f++) {
+				const DisplayChange *change = get_frame_changes(f);
+				for(size_t i=get_change_count(f); i>0; i--, change++) {
+					if(change->ChangeType==DisplayChange::Type::REMOVE)
+						displaylist.erase(change->depth);
+					else
+						displaylist[change->depth] = change->character;
+				}
+			}
+			return displaylist;
+		}
+	};
 
 	struct Dictionary
 	{
 		FillStyleMap FillStyles;
 		LineStyleMap LineStyles;
 		CharacterDict CharacterList;
-		FrameList Frames;
+		Timeline Frames;
 
 		uint8_t NumFillBits : 4;
 		uint8_t NumLineBits : 4;
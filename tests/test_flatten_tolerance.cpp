@@ -0,0 +1,99 @@
+// Measures how far flattened quadratics actually stray from their curves, once drawn through
+// the matrix, and checks that it never exceeds the tolerance. Exits non-zero on failure.
+#include "../swfflatten.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace SWF;
+
+static void apply(const Matrix &m, float x, float y, float &outx, float &outy)
+{
+	outx = x*m.ScaleX + y*m.RotateSkew1;
+	outy = x*m.RotateSkew0 + y*m.ScaleY;
+}
+
+static float distance_to_chord(float px, float py, float ax, float ay, float bx, float by)
+{
+	float dx = bx-ax, dy = by-ay;
+	float length = dx*dx+dy*dy;
+	float t = length>0.0f ? ((px-ax)*dx+(py-ay)*dy)/length : 0.0f;
+	t = t<0.0f ? 0.0f : (t>1.0f ? 1.0f : t);
+	return hypotf(px-(ax+t*dx), py-(ay+t*dy));
+}
+
+// Largest distance from the curve between t0 and t1 to the chord a-b, in device space
+static float chord_deviation(const Matrix &m, const QuadraticBatch &c, size_t i, float t0, float t1, float ax, float ay, float bx, float by)
+{
+	float worst = 0.0f;
+	for(int k=0; k<=64; k++) {
+		float t = t0+(t1-t0)*k/64.0f, u = 1.0f-t;
+		float px, py;
+		apply(m, u*u*c.x0[i]+2.0f*u*t*c.cx[i]+t*t*c.x1[i], u*u*c.y0[i]+2.0f*u*t*c.cy[i]+t*t*c.y1[i], px, py);
+		float d = distance_to_chord(px, py, ax, ay, bx, by);
+		if(d>worst)	worst = d;
+	}
+	return worst;
+}
+
+int main()
+{
+	const size_t count = 203;	// Not a multiple of four, so the scalar tail runs too
+	const float tolerances[3] = { 0.05f, 0.25f, 1.0f };
+	Matrix matrices[3];
+	matrices[1].ScaleX = 3.0f;
+	matrices[1].ScaleY = 0.5f;
+	matrices[2].ScaleX = matrices[2].ScaleY = 1.4142f;
+	matrices[2].RotateSkew0 = 0.9f;
+	matrices[2].RotateSkew1 = -0.9f;
+
+	srand(17);
+	std::vector<float> coords(6*count);
+	for(size_t i=0; i<coords.size(); i++)
+		coords[i] = (rand()%20000)/100.0f - 100.0f;
+	QuadraticBatch batch;
+	batch.x0 = &coords[0];			batch.y0 = &coords[count];
+	batch.cx = &coords[2*count];	batch.cy = &coords[3*count];
+	batch.x1 = &coords[4*count];	batch.y1 = &coords[5*count];
+	batch.count = count;
+
+	int failures = 0;
+	float worstratio = 0.0f;
+	std::vector<uint32_t> segments(count);
+	for(int mi=0; mi<3; mi++) {
+		for(int ti=0; ti<3; ti++) {
+			const Matrix &m = matrices[mi];
+			float tolerance = tolerances[ti];
+			std::vector<float> points(2*count_quadratic_segments(batch, m, tolerance, segments.data()));
+			flatten_quadratics(batch, segments.data(), points.data());
+			const float *p = points.data();
+			for(size_t i=0; i<count; i++) {
+				uint32_t n = segments[i];
+				float ax, ay, bx, by;
+				apply(m, batch.x0[i], batch.y0[i], ax, ay);
+				float worst = 0.0f;
+				for(uint32_t s=0; s<n; s++, p+=2) {
+					apply(m, p[0], p[1], bx, by);
+					float d = chord_deviation(m, batch, i, (float)s/n, (float)(s+1)/n, ax, ay, bx, by);
+					if(d>worst)	worst = d;
+					ax = bx;
+					ay = by;
+				}
+				if(n>=FLATTEN_MAX_SEGMENTS)	// Capped curves make no promise about tolerance
+					continue;
+				if(worst/tolerance>worstratio)	worstratio = worst/tolerance;
+				if(worst>tolerance*1.001f) {
+					printf("curve %u, matrix %d: %u segments stray %g pixels, tolerance %g\n", (unsigned)i, mi, n, worst, tolerance);
+					failures++;
+				}
+			}
+		}
+	}
+	printf("worst deviation %.3f of tolerance\n", worstratio);
+	if(failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
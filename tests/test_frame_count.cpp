@@ -0,0 +1,52 @@
+// Checks that a parse with no frame limit reads every frame, even past 65535 of them, and that a
+// frame limit stops where it says. Exits non-zero on failure.
+#include "../swfparser.h"
+#include <cstdio>
+#include <vector>
+using namespace SWF;
+
+#define TEST_FRAMES	70000
+
+static std::vector<uint8_t> build_movie()
+{
+	// Empty stage RECT (5 bit field size of 0), 24fps, then ShowFrame tags and End
+	std::vector<uint8_t> swf = { 'F', 'W', 'S', 10, 0, 0, 0, 0, 0x00, 0, 24, 0xFF, 0xFF };
+	for(int i=0; i<TEST_FRAMES; i++) {
+		swf.push_back((TagType::ShowFrame<<6)&0xFF);
+		swf.push_back(TagType::ShowFrame>>2);
+	}
+	swf.push_back(0);
+	swf.push_back(0);
+	uint32_t length = (uint32_t)swf.size();
+	for(int i=0; i<4; i++)
+		swf[4+i] = (length>>(i*8))&0xFF;
+	return swf;
+}
+
+static size_t parse(uint16_t framelimit)
+{
+	std::vector<uint8_t> swf = build_movie();
+	Parser parser;
+	ParseOptions options;
+	options.frame_limit = framelimit;
+	parser.set_options(options);
+	if(parser.parse_swf_data(swf.data(), (uint32_t)swf.size())!=Error::OK)
+		return 0;
+	return parser.get_dict()->Frames.size();
+}
+
+int main()
+{
+	size_t frames = parse(0);
+	if(frames!=TEST_FRAMES) {
+		printf("unlimited parse read %u of %u frames\n", (unsigned)frames, TEST_FRAMES);
+		return 1;
+	}
+	frames = parse(1000);
+	if(frames!=1000) {
+		printf("parse limited to 1000 frames read %u\n", (unsigned)frames);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,69 @@
+// Checks that the SIMD gradient baker gives the same bytes as the scalar one, for both
+// interpolation modes, with and without colour transforms. Exits non-zero on failure.
+#include "../swfgradient.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using namespace SWF;
+
+static Gradient random_gradient(GradInterpMode mode)
+{
+	Gradient gradient;
+	gradient.SpreadMode = PAD;
+	gradient.InterpolationMode = mode;
+	gradient.NumGradients = 1+rand()%GRADIENT_MAX_RECORDS;
+	int ratio = 0;
+	for(int i=0; i<gradient.NumGradients; i++) {
+		ratio = std::min(255, ratio+rand()%(256/gradient.NumGradients+1));
+		GradRecord &record = gradient.GradientRecords[i];
+		record.Ratio = (uint8_t)ratio;
+		record.Color.r = rand()%256;
+		record.Color.g = rand()%256;
+		record.Color.b = rand()%256;
+		record.Color.a = (rand()%4) ? rand()%256 : 255;
+	}
+	return gradient;
+}
+
+static CXForm random_cxform()
+{
+	CXForm cx;
+	cx.RedMultTerm = (rand()%512)/256.0f;
+	cx.GreenMultTerm = (rand()%512)/256.0f;
+	cx.BlueMultTerm = (rand()%512)/256.0f;
+	cx.AlphaMultTerm = (rand()%512)/256.0f;
+	cx.RedAddTerm = rand()%512-256;
+	cx.GreenAddTerm = rand()%512-256;
+	cx.BlueAddTerm = rand()%512-256;
+	cx.AlphaAddTerm = rand()%512-256;
+	return cx;
+}
+
+int main()
+{
+	srand(22);
+	int failures = 0;
+	for(int n=0; n<4000; n++) {
+		Gradient gradient = random_gradient((n&1) ? LINEAR_RGB : RGB);
+		CXForm cx = random_cxform();
+		const CXForm *cxform = (n&2) ? &cx : NULL;
+		GradientRamp simd, scalar;
+		bake_gradient_ramp(gradient, simd, cxform);
+		bake_gradient_ramp_scalar(gradient, scalar, cxform);
+		for(int i=0; i<GRADIENT_RAMP_SIZE*4; i++) {
+			if(simd.texels[i]!=scalar.texels[i]) {
+				printf("gradient %d, %s, texel %d channel %d: %d and %d\n", n, (n&1) ? "linear" : "rgb",
+					i/4, i%4, simd.texels[i], scalar.texels[i]);
+				failures++;
+				break;
+			}
+		}
+	}
+	if(failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,57 @@
+// Checks that asking a lazy parser for a shape more than once decodes its tag only once, even
+// when the shape has no edges and so never becomes a character. Exits non-zero on failure.
+#include "../swfparser.h"
+#include <cstdio>
+#include <vector>
+using namespace SWF;
+
+static void put_tag(std::vector<uint8_t> &swf, uint16_t tag, const std::vector<uint8_t> &body)
+{
+	uint16_t header = (tag<<6) | (uint16_t)body.size();
+	swf.push_back(header&0xFF);
+	swf.push_back(header>>8);
+	swf.insert(swf.end(), body.begin(), body.end());
+}
+
+static std::vector<uint8_t> build_movie()
+{
+	// Empty stage RECT (5 bit field size of 0), 24fps, one frame
+	std::vector<uint8_t> swf = { 'F', 'W', 'S', 10, 0, 0, 0, 0, 0x00, 0, 24, 1, 0 };
+	put_tag(swf, TagType::DefineShape, {
+		1, 0,				// Character id
+		0x00,				// Empty bounds
+		1, 0x00, 255, 0, 0,	// One solid red fill style
+		0,					// No line styles
+		0x11,				// One bit each for fill and line indices
+		0x00				// End of shape, with no edges
+	});
+	put_tag(swf, TagType::ShowFrame, {});
+	put_tag(swf, TagType::End, {});
+	uint32_t length = (uint32_t)swf.size();
+	for(int i=0; i<4; i++)
+		swf[4+i] = (length>>(i*8))&0xFF;
+	return swf;
+}
+
+int main()
+{
+	std::vector<uint8_t> swf = build_movie();
+	Parser parser;
+	ParseOptions options;
+	options.lazy = true;
+	parser.set_options(options);
+	if(parser.parse_swf_data(swf.data(), (uint32_t)swf.size())!=Error::OK) {
+		printf("lazy parse failed\n");
+		return 1;
+	}
+	for(int i=0; i<3; i++)
+		parser.get_character(1);
+	FillStyleMap::iterator fills = parser.get_dict()->FillStyles.find(1);
+	size_t count = (fills!=parser.get_dict()->FillStyles.end()) ? fills->second.size() : 0;
+	if(count!=1) {
+		printf("shape 1 has %u fill styles after three lookups, expected 1\n", (unsigned)count);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
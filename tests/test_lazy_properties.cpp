@@ -0,0 +1,91 @@
+// Checks that a lazy parse reports the same movie Properties as an eager one.
+// Build against the library sources; exits non-zero on failure.
+#include "../swfparser.h"
+#include <cstdio>
+#include <vector>
+using namespace SWF;
+
+static void put_tag(std::vector<uint8_t> &swf, uint16_t tag, const std::vector<uint8_t> &body)
+{
+	uint16_t header = (tag<<6) | (uint16_t)body.size();
+	swf.push_back(header&0xFF);
+	swf.push_back(header>>8);
+	swf.insert(swf.end(), body.begin(), body.end());
+}
+
+static std::vector<uint8_t> build_movie()
+{
+	std::vector<uint8_t> swf = { 'F', 'W', 'S', 10, 0, 0, 0, 0 };
+	// RECT 0,11000,0,8000 in 14 bit fields
+	uint32_t values[4] = { 0, 11000, 0, 8000 };
+	uint64_t bits = 14;
+	int count = 5;
+	for(int i=0; i<4; i++) {
+		bits = (bits<<14) | values[i];
+		count += 14;
+	}
+	bits <<= (64-count);
+	for(int i=7; i>=0; i--)
+		swf.push_back((bits>>(i*8))&0xFF);
+	swf.push_back(0);	// Frame rate 24.0
+	swf.push_back(24);
+	swf.push_back(2);	// Frame count
+	swf.push_back(0);
+	put_tag(swf, TagType::FileAttributes, { 0x08, 0, 0, 0 });
+	put_tag(swf, TagType::SetBackgroundColor, { 10, 20, 30 });
+	put_tag(swf, TagType::ShowFrame, {});
+	put_tag(swf, TagType::ShowFrame, {});
+	put_tag(swf, TagType::End, {});
+	uint32_t length = (uint32_t)swf.size();
+	for(int i=0; i<4; i++)
+		swf[4+i] = (length>>(i*8))&0xFF;
+	return swf;
+}
+
+static bool parse(ParseOptions options, Properties &props)
+{
+	std::vector<uint8_t> swf = build_movie();
+	Parser parser;
+	parser.set_options(options);
+	if(parser.parse_swf_data(swf.data(), (uint32_t)swf.size())!=Error::OK)
+		return false;
+	if(options.lazy && parser.decode_frames()!=Error::OK)
+		return false;
+	props = *parser.get_properties();
+	return true;
+}
+
+static bool same(const Properties &a, const Properties &b)
+{
+	return a.version==b.version && a.framerate==b.framerate && a.framecount==b.framecount &&
+		a.dimensions.xmin==b.dimensions.xmin && a.dimensions.xmax==b.dimensions.xmax &&
+		a.dimensions.ymin==b.dimensions.ymin && a.dimensions.ymax==b.dimensions.ymax &&
+		a.bgcolour.r==b.bgcolour.r && a.bgcolour.g==b.bgcolour.g && a.bgcolour.b==b.bgcolour.b && a.bgcolour.a==b.bgcolour.a;
+}
+
+int main()
+{
+	Properties eager, lazy, limited;
+	ParseOptions options;
+	if(!parse(options, eager)) {
+		printf("eager parse failed\n");
+		return 1;
+	}
+	if(eager.bgcolour.r!=10 || eager.bgcolour.g!=20 || eager.bgcolour.b!=30) {
+		printf("eager parse lost the background colour\n");
+		return 1;
+	}
+	options.lazy = true;
+	if(!parse(options, lazy) || !same(eager, lazy)) {
+		printf("lazy Properties differ: bg=%d,%d,%d\n", lazy.bgcolour.r, lazy.bgcolour.g, lazy.bgcolour.b);
+		return 1;
+	}
+	options.lazy = false;
+	options.frame_limit = 1;
+	if(!parse(options, limited) || !same(eager, limited)) {
+		printf("frame limited Properties differ\n");
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,69 @@
+// Checks Point::transform against the batched transform_points(). Build it once as is and once
+// with -DLIBSHOCKWAVE_INTEGER_TWIPS, where points must land on the nearest whole twip.
+#include "../swftransform.h"
+#include <cmath>
+#include <cstdio>
+using namespace SWF;
+
+static bool check(const Matrix &m, Coord x, Coord y)
+{
+	Point p;
+	p.x = x;
+	p.y = y;
+	p.transform(m);
+	float outx, outy;
+	transform_points(m, &x, &y, &outx, &outy, 1);
+#ifdef LIBSHOCKWAVE_INTEGER_TWIPS
+	const float tolerance = 0.5f/20.0f + 1e-4f;	// Half a twip, in pixels
+#else
+	const float tolerance = 1e-4f;
+#endif
+	if(fabsf(coord_to_float(p.x)-outx)>tolerance || fabsf(coord_to_float(p.y)-outy)>tolerance) {
+		printf("(%g,%g) -> (%g,%g), batched (%g,%g)\n", coord_to_float(x), coord_to_float(y),
+			coord_to_float(p.x), coord_to_float(p.y), outx, outy);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	Matrix matrices[4];
+	matrices[1].ScaleX = 0.6f;
+	matrices[1].ScaleY = -0.6f;
+	matrices[2].ScaleX = matrices[2].ScaleY = 0.70710678f;
+	matrices[2].RotateSkew0 = 0.70710678f;
+	matrices[2].RotateSkew1 = -0.70710678f;
+	matrices[2].TranslateX = twips_to_coord(213);
+	matrices[2].TranslateY = twips_to_coord(-77);
+	matrices[3].ScaleX = 1.37f;
+	matrices[3].ScaleY = 0.29f;
+	matrices[3].RotateSkew0 = -0.11f;
+	matrices[3].RotateSkew1 = 0.53f;
+	matrices[3].TranslateX = twips_to_coord(-4001);
+	matrices[3].TranslateY = twips_to_coord(1999);
+
+	int failures = 0;
+	for(int i=0; i<4; i++)
+		for(int32_t x=-2003; x<=2003; x+=97)
+			for(int32_t y=-1501; y<=1501; y+=89)
+				if(!check(matrices[i], twips_to_coord(x), twips_to_coord(y)))
+					failures++;
+
+	// One twip scaled by 0.6 is closer to one twip than to none, on either side of zero
+	Point p;
+	p.x = twips_to_coord(1);
+	p.y = twips_to_coord(1);
+	p.transform(matrices[1]);
+	if(coord_to_twips(p.x)!=1 || coord_to_twips(p.y)!=-1) {
+		printf("0.6 twips rounded to %d,%d\n", coord_to_twips(p.x), coord_to_twips(p.y));
+		failures++;
+	}
+
+	if(failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,144 @@
+// Renders a self-intersecting pentagram with the software renderer. DefineShape fills it
+// even-odd, leaving the centre empty; DefineShape4 can ask for non-zero, which fills the centre.
+// Exits non-zero on failure.
+#include "../swfrenderer.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+using namespace SWF;
+
+class BitWriter
+{
+	std::vector<uint8_t> &out;
+	uint32_t buffer = 0;
+	int count = 0;
+
+public:
+	BitWriter(std::vector<uint8_t> &o) : out(o) {}
+	void put(uint32_t value, int bits)
+	{
+		for(int i=bits-1; i>=0; i--) {
+			buffer = (buffer<<1) | ((value>>i)&1);
+			if(++count==8) {
+				out.push_back((uint8_t)buffer);
+				buffer = 0;
+				count = 0;
+			}
+		}
+	}
+	void flush()
+	{
+		if(count)
+			put(0, 8-count);
+	}
+};
+
+static void put_tag(std::vector<uint8_t> &swf, uint16_t tag, const std::vector<uint8_t> &body)
+{
+	swf.push_back(0x3F | ((tag<<6)&0xFF));	// Long form, so bodies of any length fit
+	swf.push_back(tag>>2);
+	uint32_t length = (uint32_t)body.size();
+	for(int i=0; i<4; i++)
+		swf.push_back((length>>(i*8))&0xFF);
+	swf.insert(swf.end(), body.begin(), body.end());
+}
+
+static void put_rect(std::vector<uint8_t> &body, int32_t size)
+{
+	BitWriter bits(body);
+	bits.put(14, 5);
+	bits.put(0, 14);
+	bits.put(size, 14);
+	bits.put(0, 14);
+	bits.put(size, 14);
+	bits.flush();
+}
+
+static std::vector<uint8_t> build_movie(bool shape4)
+{
+	const int32_t stage = 4000;
+	std::vector<uint8_t> swf = { 'F', 'W', 'S', 10, 0, 0, 0, 0 };
+	put_rect(swf, stage);
+	swf.insert(swf.end(), { 0, 24, 1, 0 });
+	put_tag(swf, TagType::SetBackgroundColor, { 255, 255, 255 });
+
+	std::vector<uint8_t> shape = { 1, 0 };
+	put_rect(shape, stage);
+	if(shape4) {
+		put_rect(shape, stage);
+		shape.push_back(0x04);	// UsesFillWindingRule
+		shape.insert(shape.end(), { 1, 0x00, 255, 0, 0, 255, 0 });	// Red fill, no lines
+	} else {
+		shape.insert(shape.end(), { 1, 0x00, 255, 0, 0, 0 });
+	}
+	shape.push_back(0x10);	// One fill index bit, no line index bits
+	BitWriter bits(shape);
+	int32_t x[6], y[6];
+	for(int k=0; k<=5; k++) {	// Every second point of a pentagon, so the outline crosses itself
+		double angle = ((k*2)%5)*2.0*M_PI/5.0 - M_PI/2.0;
+		x[k] = (int32_t)lround(2000.0 + 1800.0*cos(angle));
+		y[k] = (int32_t)lround(2000.0 + 1800.0*sin(angle));
+	}
+	bits.put(0, 1);			// Style change: move to the first point and select fill style 1
+	bits.put(0x05, 5);
+	bits.put(13, 5);
+	bits.put(x[0], 13);
+	bits.put(y[0], 13);
+	bits.put(1, 1);
+	for(int k=1; k<=5; k++) {
+		bits.put(0x3, 2);	// Straight edge
+		bits.put(14-2, 4);
+		bits.put(1, 1);		// General line
+		bits.put((uint32_t)(x[k]-x[k-1])&0x3FFF, 14);
+		bits.put((uint32_t)(y[k]-y[k-1])&0x3FFF, 14);
+	}
+	bits.put(0, 6);			// End of shape
+	bits.flush();
+	put_tag(swf, shape4 ? TagType::DefineShape4 : TagType::DefineShape, shape);
+	put_tag(swf, TagType::PlaceObject2, { 0x02, 1, 0, 1, 0 });
+	put_tag(swf, TagType::ShowFrame, {});
+	put_tag(swf, TagType::End, {});
+	uint32_t length = (uint32_t)swf.size();
+	for(int i=0; i<4; i++)
+		swf[4+i] = (length>>(i*8))&0xFF;
+	return swf;
+}
+
+// Returns the green channel at the centre of the star and inside its top point, or false on error
+static bool render(bool shape4, int &centre, int &point)
+{
+	std::vector<uint8_t> swf = build_movie(shape4);
+	Parser parser;
+	if(parser.parse_swf_data(swf.data(), (uint32_t)swf.size())!=Error::OK)
+		return false;
+	Renderer renderer(parser.get_dict(), parser.get_properties(), 1);
+	std::vector<uint8_t> image(100*100*4);
+	if(renderer.render_frame(0, 100, 100, image.data())!=Error::OK)
+		return false;
+	centre = image[(50*100+50)*4+1];	// Green is 255 on the white background and 0 on the red fill
+	point = image[(15*100+50)*4+1];
+	return true;
+}
+
+int main()
+{
+	int centre, point;
+	if(!render(false, centre, point)) {
+		printf("DefineShape movie failed to render\n");
+		return 1;
+	}
+	if(centre!=255 || point!=0) {
+		printf("even-odd star: centre green %d, point green %d; expected an empty centre\n", centre, point);
+		return 1;
+	}
+	if(!render(true, centre, point)) {
+		printf("DefineShape4 movie failed to render\n");
+		return 1;
+	}
+	if(centre!=0 || point!=0) {
+		printf("non-zero star: centre green %d, point green %d; expected a filled centre\n", centre, point);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,138 @@
+// Renders a gradient whose stops are fully transparent through a colour transform that adds
+// opaque alpha. The transform applies to straight colours before premultiplying, so the stops'
+// colour must survive. Exits non-zero on failure.
+#include "../swfrenderer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace SWF;
+
+class BitWriter
+{
+	std::vector<uint8_t> &out;
+	uint32_t buffer = 0;
+	int count = 0;
+
+public:
+	BitWriter(std::vector<uint8_t> &o) : out(o) {}
+	void put(uint32_t value, int bits)
+	{
+		for(int i=bits-1; i>=0; i--) {
+			buffer = (buffer<<1) | ((value>>i)&1);
+			if(++count==8) {
+				out.push_back((uint8_t)buffer);
+				buffer = 0;
+				count = 0;
+			}
+		}
+	}
+	void flush()
+	{
+		if(count)
+			put(0, 8-count);
+	}
+};
+
+static void put_tag(std::vector<uint8_t> &swf, uint16_t tag, const std::vector<uint8_t> &body)
+{
+	swf.push_back(0x3F | ((tag<<6)&0xFF));	// Long form, so bodies of any length fit
+	swf.push_back(tag>>2);
+	uint32_t length = (uint32_t)body.size();
+	for(int i=0; i<4; i++)
+		swf.push_back((length>>(i*8))&0xFF);
+	swf.insert(swf.end(), body.begin(), body.end());
+}
+
+static void put_rect(std::vector<uint8_t> &body, int32_t size)
+{
+	BitWriter bits(body);
+	bits.put(14, 5);
+	bits.put(0, 14);
+	bits.put(size, 14);
+	bits.put(0, 14);
+	bits.put(size, 14);
+	bits.flush();
+}
+
+static std::vector<uint8_t> build_movie()
+{
+	const int32_t stage = 4000;
+	std::vector<uint8_t> swf = { 'F', 'W', 'S', 10, 0, 0, 0, 0 };
+	put_rect(swf, stage);
+	swf.insert(swf.end(), { 0, 24, 1, 0 });
+	put_tag(swf, TagType::SetBackgroundColor, { 255, 255, 255 });
+
+	std::vector<uint8_t> shape = { 1, 0 };
+	put_rect(shape, stage);
+	shape.insert(shape.end(), {
+		1, 0x10,				// One linear gradient fill style
+		0x00,					// Identity gradient matrix
+		0x02,					// Pad, RGB interpolation, two stops
+		0, 200, 100, 50, 0,		// Both stops are the same colour with zero alpha
+		255, 200, 100, 50, 0,
+		0,						// No line styles
+		0x10					// One fill index bit, no line index bits
+	});
+	BitWriter bits(shape);
+	bits.put(0, 1);			// Style change: move to the origin and select fill style 1
+	bits.put(0x05, 5);
+	bits.put(1, 5);
+	bits.put(0, 1);
+	bits.put(0, 1);
+	bits.put(1, 1);
+	const int32_t dx[4] = { stage, 0, -stage, 0 }, dy[4] = { 0, stage, 0, -stage };
+	for(int k=0; k<4; k++) {
+		bits.put(0x3, 2);	// Straight edge
+		bits.put(14-2, 4);
+		bits.put(1, 1);		// General line
+		bits.put((uint32_t)dx[k]&0x3FFF, 14);
+		bits.put((uint32_t)dy[k]&0x3FFF, 14);
+	}
+	bits.put(0, 6);			// End of shape
+	bits.flush();
+	put_tag(swf, TagType::DefineShape3, shape);
+
+	std::vector<uint8_t> place = { 0x0A, 1, 0, 1, 0 };	// Character and colour transform
+	BitWriter cxform(place);
+	cxform.put(1, 1);		// Add terms only, of 10 bits each
+	cxform.put(0, 1);
+	cxform.put(10, 4);
+	cxform.put(0, 10);
+	cxform.put(0, 10);
+	cxform.put(0, 10);
+	cxform.put(255, 10);	// AlphaAddTerm
+	cxform.flush();
+	put_tag(swf, TagType::PlaceObject2, place);
+	put_tag(swf, TagType::ShowFrame, {});
+	put_tag(swf, TagType::End, {});
+	uint32_t length = (uint32_t)swf.size();
+	for(int i=0; i<4; i++)
+		swf[4+i] = (length>>(i*8))&0xFF;
+	return swf;
+}
+
+int main()
+{
+	std::vector<uint8_t> swf = build_movie();
+	Parser parser;
+	if(parser.parse_swf_data(swf.data(), (uint32_t)swf.size())!=Error::OK) {
+		printf("parse failed\n");
+		return 1;
+	}
+	Renderer renderer(parser.get_dict(), parser.get_properties(), 1);
+	std::vector<uint8_t> image(64*64*4);
+	if(renderer.render_frame(0, 64, 64, image.data())!=Error::OK) {
+		printf("render failed\n");
+		return 1;
+	}
+	const uint8_t *pixel = &image[(32*64+32)*4];
+	const int expected[4] = { 200, 100, 50, 255 };
+	for(int i=0; i<4; i++) {
+		if(abs(pixel[i]-expected[i])>1) {
+			printf("centre pixel is %d,%d,%d,%d, expected 200,100,50,255\n", pixel[0], pixel[1], pixel[2], pixel[3]);
+			return 1;
+		}
+	}
+	printf("ok\n");
+	return 0;
+}